@@ -28,21 +28,44 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 //#define APCLIENT_DEBUG // to get debug output
 //#define AP_NO_DEFAULT_DATA_PACKAGE_STORE // to disable auto-construction of data package store
 //#define AP_NO_SCHEMA // to disable schema checking
-//#define AP_PREFER_UNENCRYPTED // try unencrypted connection first, then encrypted
+//#define AP_PREFER_UNENCRYPTED // use unencrypted connection as primary when racing unencrypted and encrypted
+//#define AP_NO_THREADS // to never start threads, default for emscripten without pthreads
+
+#if defined __EMSCRIPTEN__ && !defined __EMSCRIPTEN_PTHREADS__ && !defined AP_NO_THREADS
+#define AP_NO_THREADS
+#endif
 
 
+#include <algorithm>
 #include <chrono>
 #include <cinttypes>
+#include <climits>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <limits>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <random>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
+#ifndef AP_NO_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <system_error>
+#include <thread>
+#endif
 #include <wswrap.hpp>
 
 // check for optional
@@ -103,6 +126,28 @@ public:
 
     virtual bool load(const std::string& game, const std::string& checksum, json& data) = 0;
     virtual bool save(const std::string& game, const json& data) = 0;
+
+    /// Get approximate size in bytes of the last saved data for game or 0 if unknown. Used to batch requests.
+    virtual size_t get_size_hint(const std::string& game)
+    {
+        (void)game;
+        return 0;
+    }
+
+    /// Check if data for game with checksum may be available. Has to be cheap, since it is called for every game in
+    /// lazy mode; return true if that can not be determined without loading the data.
+    virtual bool contains(const std::string& game, const std::string& checksum)
+    {
+        (void)game;
+        (void)checksum;
+        return true;
+    }
+
+    /// Return true if the store can be used from multiple threads at once. Calls are serialized otherwise.
+    virtual bool is_thread_safe() const
+    {
+        return false;
+    }
 };
 
 
@@ -111,6 +156,27 @@ public:
 #endif
 
 
+namespace AP {
+    namespace detail {
+        /// Hash that is perfect for the color names of TextColor
+        constexpr size_t text_color_hash(const char* s, size_t len)
+        {
+            return (len * 7 + static_cast<unsigned char>(s[0]) * 2 + static_cast<unsigned char>(s[2])
+                    + static_cast<unsigned char>(s[len - 1]) * 6) % 46;
+        }
+
+        constexpr bool equals(const char* s, size_t len, const char* name)
+        {
+            for (size_t i = 0; i < len; i++) {
+                if (s[i] != name[i] || !name[i])
+                    return false;
+            }
+            return !name[len];
+        }
+    } // namespace detail
+} // namespace AP
+
+
 /**
  * Archipelago Client implementation.
  *
@@ -130,6 +196,10 @@ protected:
 
 public:
     static constexpr int64_t INVALID_NAME_ID = std::numeric_limits<int64_t>::min();
+    /// Interned game name, \sa see get_game_id
+    typedef uint32_t GameId;
+    static constexpr GameId ARCHIPELAGO_GAME_ID = 0;
+    static constexpr GameId INVALID_GAME_ID = std::numeric_limits<GameId>::max();
 #if !defined _MSC_VER || _MSC_VER >= 1911
     static constexpr char DEFAULT_URI[] = "localhost:38281";
 #else
@@ -180,13 +250,22 @@ public:
             } else {
                 _uri = uri;
             }
-            const auto pColon = _uri.find(':', p + 3); // FIXME: this fails for IPv6 addresses
-            const auto pSlash = _uri.find('/', p + 3);
-            if (pColon == std::string::npos || (pSlash != std::string::npos && pColon > pSlash)) {
-                auto tmp = _uri.substr(0, pSlash) + ":38281";
-                if (pSlash != std::string::npos) tmp += _uri.substr(pSlash);
-                _uri = tmp;
+            const auto hostStart = p + 3;
+            const auto pSlash = _uri.find('/', hostStart);
+            auto host = _uri.substr(hostStart, pSlash == std::string::npos ? pSlash : pSlash - hostStart);
+            bool hasPort;
+            if (!host.empty() && host[0] == '[') { // [IPv6]:port
+                const auto pBracket = host.find(']');
+                hasPort = pBracket != std::string::npos && host.find(':', pBracket) != std::string::npos;
+            } else if (std::count(host.begin(), host.end(), ':') > 1) { // IPv6 without brackets can't have a port
+                host = "[" + host + "]";
+                hasPort = false;
+            } else {
+                hasPort = host.find(':') != std::string::npos;
             }
+            if (!hasPort)
+                host += ":38281";
+            _uri = _uri.substr(0, hostStart) + host + (pSlash == std::string::npos ? "" : _uri.substr(pSlash));
         }
 
         if (!_dataPackageStore) {
@@ -204,18 +283,12 @@ public:
 
         _uuid = uuid;
         _game = game;
+        intern_game("Archipelago"); // ARCHIPELAGO_GAME_ID
         _dataPackage = {
             {"version", -1},
             {"games", json(json::value_t::object)},
         };
 
-        #ifndef AP_NO_SCHEMA
-        valijson::SchemaParser parser;
-        parser.populateSchema(JsonSchemaAdapter(_packetSchemaJson), _packetSchema);
-        parser.populateSchema(JsonSchemaAdapter(_retrievedSchemaJson), _commandSchemas["Retrieved"]);
-        parser.populateSchema(JsonSchemaAdapter(_setReplySchemaJson), _commandSchemas["SetReply"]);
-        #endif
-
         // Connect on first poll
         _reconnectNow = true;
     }
@@ -302,24 +375,178 @@ public:
     struct NetworkSlot {
         std::string name;
         std::string game;
+        GameId gameId = INVALID_GAME_ID;
         SlotType type{};
         std::list<int> members;
     };
 
+    /// Colors and styles used in PrintJSON and by render_json
+    enum class TextColor : uint8_t {
+        NONE,
+        UNKNOWN, ///< color was set, but is not known
+        BOLD,
+        UNDERLINE,
+        BLACK,
+        RED,
+        GREEN,
+        YELLOW,
+        BLUE,
+        MAGENTA,
+        CYAN,
+        WHITE,
+        BLACK_BG,
+        RED_BG,
+        GREEN_BG,
+        YELLOW_BG,
+        BLUE_BG,
+        MAGENTA_BG,
+        CYAN_BG,
+        WHITE_BG,
+        PLUM,
+        SLATEBLUE,
+        SALMON,
+        GRAY,
+    };
+
+    /// Parse color name, see TextColor
+    static constexpr TextColor parse_text_color(const char* s, size_t len)
+    {
+        if (len == 0)
+            return TextColor::NONE;
+        if (len < 3)
+            return TextColor::UNKNOWN;
+        // perfect hash over the known names; a collision would be a duplicate case label
+        switch (AP::detail::text_color_hash(s, len)) {
+            case AP::detail::text_color_hash("bold", 4):
+                return AP::detail::equals(s, len, "bold") ? TextColor::BOLD : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("underline", 9):
+                return AP::detail::equals(s, len, "underline") ? TextColor::UNDERLINE : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("black", 5):
+                return AP::detail::equals(s, len, "black") ? TextColor::BLACK : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("red", 3):
+                return AP::detail::equals(s, len, "red") ? TextColor::RED : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("green", 5):
+                return AP::detail::equals(s, len, "green") ? TextColor::GREEN : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("yellow", 6):
+                return AP::detail::equals(s, len, "yellow") ? TextColor::YELLOW : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("blue", 4):
+                return AP::detail::equals(s, len, "blue") ? TextColor::BLUE : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("magenta", 7):
+                return AP::detail::equals(s, len, "magenta") ? TextColor::MAGENTA : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("cyan", 4):
+                return AP::detail::equals(s, len, "cyan") ? TextColor::CYAN : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("white", 5):
+                return AP::detail::equals(s, len, "white") ? TextColor::WHITE : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("black_bg", 8):
+                return AP::detail::equals(s, len, "black_bg") ? TextColor::BLACK_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("red_bg", 6):
+                return AP::detail::equals(s, len, "red_bg") ? TextColor::RED_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("green_bg", 8):
+                return AP::detail::equals(s, len, "green_bg") ? TextColor::GREEN_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("yellow_bg", 9):
+                return AP::detail::equals(s, len, "yellow_bg") ? TextColor::YELLOW_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("blue_bg", 7):
+                return AP::detail::equals(s, len, "blue_bg") ? TextColor::BLUE_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("magenta_bg", 10):
+                return AP::detail::equals(s, len, "magenta_bg") ? TextColor::MAGENTA_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("cyan_bg", 7):
+                return AP::detail::equals(s, len, "cyan_bg") ? TextColor::CYAN_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("white_bg", 8):
+                return AP::detail::equals(s, len, "white_bg") ? TextColor::WHITE_BG : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("plum", 4):
+                return AP::detail::equals(s, len, "plum") ? TextColor::PLUM : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("slateblue", 9):
+                return AP::detail::equals(s, len, "slateblue") ? TextColor::SLATEBLUE : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("salmon", 6):
+                return AP::detail::equals(s, len, "salmon") ? TextColor::SALMON : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("gray", 4):
+                return AP::detail::equals(s, len, "gray") ? TextColor::GRAY : TextColor::UNKNOWN;
+            case AP::detail::text_color_hash("grey", 4):
+                return AP::detail::equals(s, len, "grey") ? TextColor::GRAY : TextColor::UNKNOWN;
+            default: return TextColor::UNKNOWN;
+        }
+    }
+
+    static TextColor parse_text_color(const std::string& s)
+    {
+        return parse_text_color(s.c_str(), s.length());
+    }
+
+    enum class TextNodeType : uint8_t {
+        TEXT,
+        PLAYER_ID,
+        PLAYER_NAME,
+        ITEM_ID,
+        ITEM_NAME,
+        LOCATION_ID,
+        LOCATION_NAME,
+        ENTRANCE_NAME,
+        HINT_STATUS,
+        COLOR,
+        UNKNOWN,
+    };
+
+    static TextNodeType parse_text_node_type(const std::string& type)
+    {
+        if (type.empty() || type == "text") return TextNodeType::TEXT;
+        if (type == "player_id") return TextNodeType::PLAYER_ID;
+        if (type == "player_name") return TextNodeType::PLAYER_NAME;
+        if (type == "item_id") return TextNodeType::ITEM_ID;
+        if (type == "item_name") return TextNodeType::ITEM_NAME;
+        if (type == "location_id") return TextNodeType::LOCATION_ID;
+        if (type == "location_name") return TextNodeType::LOCATION_NAME;
+        if (type == "entrance_name") return TextNodeType::ENTRANCE_NAME;
+        if (type == "hint_status") return TextNodeType::HINT_STATUS;
+        if (type == "color") return TextNodeType::COLOR;
+        return TextNodeType::UNKNOWN;
+    }
+
+    static int64_t parse_text_node_id(TextNodeType type, const std::string& text)
+    {
+        if (type != TextNodeType::PLAYER_ID && type != TextNodeType::ITEM_ID && type != TextNodeType::LOCATION_ID)
+            return 0;
+        char* end;
+        const auto id = strtoll(text.c_str(), &end, 10);
+        return (end == text.c_str()) ? static_cast<int64_t>(INVALID_NAME_ID) : static_cast<int64_t>(id);
+    }
+
+    /// Node of the list based print_json handlers, which own up to three strings per node. \sa TextMessage
     struct TextNode {
         std::string type;
+        TextNodeType nodeType = TextNodeType::TEXT; ///< parsed type
         std::string color;
+        TextColor textColor = TextColor::NONE; ///< parsed color
         std::string text;
         int player = 0;
         unsigned flags = FLAG_NONE;
         unsigned hintStatus = HINT_UNSPECIFIED;
+        int64_t id = 0; ///< parsed text for player_id, item_id and location_id nodes
 
         static TextNode from_json(const json& j)
         {
             TextNode node;
             node.type = j.value("type", "");
+            node.nodeType = parse_text_node_type(node.type);
             node.color = j.value("color", "");
+            node.textColor = parse_text_color(node.color);
             node.text = j.value("text", "");
+            node.id = parse_text_node_id(node.nodeType, node.text);
+            node.player = j.value("player", 0);
+            node.flags = j.value("flags", 0U);
+            node.hintStatus = j.value("hint_status", 0U);
+            return node;
+        }
+
+        /// Parse node, moving strings out of j
+        static TextNode from_json(json&& j)
+        {
+            TextNode node;
+            node.type = take_string(j, "type");
+            node.nodeType = parse_text_node_type(node.type);
+            node.color = take_string(j, "color");
+            node.textColor = parse_text_color(node.color);
+            node.text = take_string(j, "text");
+            node.id = parse_text_node_id(node.nodeType, node.text);
             node.player = j.value("player", 0);
             node.flags = j.value("flags", 0U);
             node.hintStatus = j.value("hint_status", 0U);
@@ -327,6 +554,105 @@ public:
         }
     };
 
+    /**
+     * PrintJSON data in contiguous storage.
+     * The text of all nodes is kept in one buffer that nodes refer to by offset, so a message takes two allocations
+     * instead of a list node and up to three strings per node. Type and color are only kept in parsed form.
+     */
+    struct TextMessage {
+        /// Text of a node, valid as long as the message is not changed. C++14 has no std::string_view.
+        struct TextView {
+            const char* data = nullptr;
+            size_t size = 0;
+
+            std::string str() const
+            {
+                return {data, size};
+            }
+
+            bool operator==(const std::string& other) const
+            {
+                return other.compare(0, std::string::npos, data, size) == 0;
+            }
+
+            bool operator!=(const std::string& other) const
+            {
+                return !(*this == other);
+            }
+        };
+
+        struct Node {
+            TextNodeType type = TextNodeType::TEXT;
+            TextColor color = TextColor::NONE;
+            uint32_t textOffset = 0; ///< start of the text in buffer
+            uint32_t textSize = 0;
+            int player = 0;
+            unsigned flags = FLAG_NONE;
+            unsigned hintStatus = HINT_UNSPECIFIED;
+            int64_t id = 0; ///< parsed text for player_id, item_id and location_id nodes
+        };
+
+        std::string buffer; ///< text of all nodes
+        std::vector<Node> nodes;
+
+        /// Get the text of a node of this message without copying it
+        TextView get_text(const Node& node) const
+        {
+            return {buffer.data() + node.textOffset, node.textSize};
+        }
+
+        /// Append a text node
+        void add_text(const std::string& text)
+        {
+            Node node;
+            node.textOffset = static_cast<uint32_t>(buffer.size());
+            node.textSize = static_cast<uint32_t>(text.size());
+            buffer += text;
+            nodes.push_back(node);
+        }
+
+        /// Parse the data array of PrintJSON
+        static TextMessage from_json(const json& data)
+        {
+            TextMessage msg;
+            size_t size = 0;
+            for (const auto& part: data)
+                size += get_string(part, "text").size();
+            msg.buffer.reserve(size);
+            msg.nodes.reserve(data.size());
+            for (const auto& part: data) {
+                const auto& text = get_string(part, "text");
+                msg.add_text(text);
+                auto& node = msg.nodes.back();
+                node.type = parse_text_node_type(get_string(part, "type"));
+                node.color = parse_text_color(get_string(part, "color"));
+                node.id = parse_text_node_id(node.type, text);
+                node.player = part.value("player", 0);
+                node.flags = part.value("flags", 0U);
+                node.hintStatus = part.value("hint_status", 0U);
+            }
+            return msg;
+        }
+    };
+
+    /// Message stored in the message history, \sa see set_message_history_budget
+    struct HistoryEntry {
+        uint64_t id = 0;
+        std::string type; ///< PrintJSON type, empty for Print
+        TextMessage data;
+        int receiving = -1; ///< receiving player if any
+        int64_t item = INVALID_NAME_ID; ///< item if any
+        int itemPlayer = -1; ///< player that owns the item's location if any
+        int slot = -1; ///< sending player for chat messages if any
+    };
+
+    /// Filter for find_message_history, unset members match everything
+    struct HistoryFilter {
+        int player = -1; ///< player that is mentioned, receives, sends or owns an item in the message
+        int64_t item = INVALID_NAME_ID; ///< item that is mentioned in the message
+        std::string type; ///< PrintJSON type, empty matches all
+    };
+
     /**
      * Parsed arguments of PrintJSON.
      * Pointer arguments are optional (null if missing).
@@ -383,6 +709,64 @@ public:
         {
             return !(*this < other);
         }
+
+        constexpr bool operator==(const Version& other) const
+        {
+            return ma == other.ma && mi == other.mi && build == other.build;
+        }
+    };
+
+    struct ReconnectPolicy {
+        enum class Jitter {
+            NONE,         ///< wait exactly the backoff delay, but retry a lost connection right away
+            FULL,         ///< wait a random time between 0 and the backoff delay
+            DECORRELATED, ///< wait a random time between initialDelay and 3 times the previous wait
+        };
+
+        unsigned long initialDelay = 1500; ///< delay in ms, multiplied before the first wait
+        double multiplier = 2;
+        unsigned long maxDelay = 15000; ///< in ms. Browsers may enforce a higher value.
+        Jitter jitter = Jitter::NONE;
+    };
+
+    /// Cumulative histogram as used by OpenMetrics. Values are in seconds.
+    struct Histogram {
+        std::vector<double> bounds; ///< upper bounds of the buckets, +Inf is implicit
+        std::vector<uint64_t> counts; ///< observations per bucket, the last one is +Inf
+        double sum = 0;
+        uint64_t count = 0;
+
+        Histogram(std::initializer_list<double> bounds = {.0001, .0005, .001, .005, .01, .05, .1, .5, 1, 5})
+            : bounds(bounds), counts(bounds.size() + 1, 0)
+        {
+        }
+
+        void observe(double value)
+        {
+            const auto it = std::lower_bound(bounds.begin(), bounds.end(), value);
+            counts[static_cast<size_t>(it - bounds.begin())]++;
+            sum += value;
+            count++;
+        }
+    };
+
+    /// Snapshot of runtime metrics, \sa see get_metrics
+    struct Metrics {
+        uint64_t bytesSent = 0;
+        uint64_t bytesReceived = 0;
+        uint64_t framesSent = 0;
+        uint64_t framesReceived = 0;
+        std::map<std::string, uint64_t> commandsSent;
+        std::map<std::string, uint64_t> commandsReceived; ///< unknown commands are counted as "other"
+        Histogram parseTime; ///< json parsing of received frames
+        Histogram validationTime; ///< schema validation of received frames
+        std::map<std::string, Histogram> handlerTime; ///< handling of received commands including callbacks, same keys
+        size_t checkQueue = 0;
+        size_t scoutQueue = 0;
+        size_t updateHintQueue = 0;
+        uint64_t connectAttempts = 0;
+        uint64_t reconnects = 0; ///< connection attempts after a connection was lost
+        Histogram timeToConnected{.1, .25, .5, 1, 2.5, 5, 10, 30, 60}; ///< first connect attempt until Connected
     };
 
     struct DataStorageOperation {
@@ -413,6 +797,12 @@ public:
         _hOnSocketDisconnected = std::move(f);
     }
 
+    /// Set a handler that receives log messages instead of them being printed to stdout.
+    void set_log_handler(std::function<void(const std::string&)> f)
+    {
+        _hOnLog = std::move(f);
+    }
+
     void set_slot_connected_handler(std::function<void(const json&)> f)
     {
         _hOnSlotConnected = std::move(f);
@@ -448,6 +838,12 @@ public:
         _hOnLocationInfo = std::move(f);
     }
 
+    /// Called when names of a game that was loaded lazily became available, \sa see set_lazy_data_package
+    void set_game_names_loaded_handler(std::function<void(const std::string& game)> f)
+    {
+        _hOnGameNamesLoaded = std::move(f);
+    }
+
     void set_data_package_changed_handler(std::function<void(const json&)> f)
     {
         _hOnDataPackageChanged = std::move(f);
@@ -461,13 +857,18 @@ public:
     void set_print_json_handler(std::function<void(const json& command)> f)
     {
         _hOnPrintJson = std::move(f);
+        _hOnPrintJsonMutable = nullptr;
     }
 
     void set_print_json_handler(const std::function<void(const PrintJSONArgs&)>& f)
     {
-        set_print_json_handler([f](const json& command) {
-            if (!f) return;
-
+        _hOnPrintJson = nullptr;
+        if (!f) {
+            _hOnPrintJsonMutable = nullptr;
+            return;
+        }
+        _hOnPrintJsonMutable = [f](json& command) {
+            // the command is not used after this, so strings are moved out instead of copied
             PrintJSONArgs args;
 
             int receiving;
@@ -479,13 +880,16 @@ public:
             std::list<std::string> tags;
             int countdown;
 
-            for (const auto& part: command["data"]) {
-                args.data.push_back(TextNode::from_json(part));
+            auto it = command.find("data");
+            if (it != command.end()) {
+                for (auto& part: *it) {
+                    args.data.push_back(TextNode::from_json(std::move(part)));
+                }
             }
 
-            args.type = command.value("type", "");
+            args.type = take_string(command, "type");
 
-            auto it = command.find("receiving");
+            it = command.find("receiving");
             if (it != command.end()) {
                receiving = *it;
                args.receiving = &receiving;
@@ -521,13 +925,14 @@ public:
 
             it = command.find("message");
             if (it != command.end()) {
-                message = *it;
+                message = take_string(*it);
                 args.message = &message;
             }
 
             it = command.find("tags");
             if (it != command.end()) {
-                it->get_to(tags);
+                for (auto& tag: *it)
+                    tags.push_back(take_string(tag));
                 args.tags = &tags;
             }
 
@@ -538,7 +943,7 @@ public:
             }
 
             f(args);
-        });
+        };
     }
 
     void set_print_json_handler(const std::function<void(const std::list<TextNode>&, const NetworkItem*, const int*)>& f)
@@ -551,17 +956,23 @@ public:
 
     void set_print_json_handler(const std::function<void(const std::list<TextNode>&)>& f)
     {
-        set_print_json_handler([f](const json& command) {
-            if (!f) return;
-
+        _hOnPrintJson = nullptr;
+        if (!f) {
+            _hOnPrintJsonMutable = nullptr;
+            return;
+        }
+        _hOnPrintJsonMutable = [f](json& command) {
             std::list<TextNode> data;
 
-            for (const auto& part: command["data"]) {
-                data.push_back(TextNode::from_json(part));
+            auto it = command.find("data");
+            if (it != command.end()) {
+                for (auto& part: *it) {
+                    data.push_back(TextNode::from_json(std::move(part)));
+                }
             }
 
             f(data);
-        });
+        };
     }
 
     void set_print_json_handler(const std::function<void(const std::list<TextNode>&, const json& extra)>& f)
@@ -571,17 +982,34 @@ public:
                 return;
 
             std::list<TextNode> data;
-            json extra;
 
             for (const auto& part: command["data"]) {
                 data.push_back(TextNode::from_json(part));
             }
 
-            for (const auto& pair: command.items()) {
-                extra[pair.key()] = pair.value();
-            }
+            f(data, command); // extra is all of the command
+        });
+    }
+
+    /// Like the overload above, but nodes are stored contiguously instead of in a list of strings.
+    void set_print_json_handler(const std::function<void(const TextMessage&, const json& extra)>& f)
+    {
+        set_print_json_handler([f](const json& command) {
+            if (!f)
+                return;
+            auto it = command.find("data");
+            f(it != command.end() ? TextMessage::from_json(*it) : TextMessage(), command);
+        });
+    }
 
-            f(data, extra);
+    /// Like the list-only overload, but nodes are stored contiguously instead of in a list of strings.
+    void set_print_json_handler(const std::function<void(const TextMessage&)>& f)
+    {
+        set_print_json_handler([f](const json& command) {
+            if (!f)
+                return;
+            auto it = command.find("data");
+            f(it != command.end() ? TextMessage::from_json(*it) : TextMessage());
         });
     }
 
@@ -595,21 +1023,31 @@ public:
         _hOnLocationChecked = std::move(f);
     }
 
-    void set_retrieved_handler(const std::function<void(const std::map<std::string,json>&)>& f)
+    /// Set retrieved handler. Values are moved out of the received packet, not copied.
+    void set_retrieved_handler(std::function<void(const std::map<std::string,json>&)> f)
     {
-        set_retrieved_handler([f](const std::map<std::string, json>& keys, const json&) {
-            if (!f)
-                return;
-
-            f(keys);
-        });
+        _hOnRetrievedJson = nullptr;
+        _hOnRetrieved = nullptr;
+        _hOnRetrievedKeys = std::move(f);
     }
 
+    /// Set retrieved handler that also receives the whole message. Values are copied, since message contains them.
     void set_retrieved_handler(std::function<void(const std::map<std::string,json>&, const json& message)> f)
     {
+        _hOnRetrievedJson = nullptr;
+        _hOnRetrievedKeys = nullptr;
         _hOnRetrieved = std::move(f);
     }
 
+    /// Set retrieved handler without any copies: keys is the "keys" object of message.
+    /// Both references are only valid during the callback.
+    void set_retrieved_json_handler(std::function<void(const json& keys, const json& message)> f)
+    {
+        _hOnRetrieved = nullptr;
+        _hOnRetrievedKeys = nullptr;
+        _hOnRetrievedJson = std::move(f);
+    }
+
     void set_set_reply_handler(std::function<void(const json& command)> f)
     {
         _hOnSetReply = std::move(f);
@@ -622,6 +1060,61 @@ public:
         });
     }
 
+    /// Set a handler that is called when a value in the local data storage cache changed.
+    /// \sa see set_data_storage_cache_enabled for details.
+    void set_data_storage_changed_handler(std::function<void(const std::string& key, const json& value)> f)
+    {
+        _hOnDataStorageChanged = std::move(f);
+    }
+
+    /// Set how long to wait between connection attempts. Use jitter to spread out reconnects of many clients.
+    /// A multiplier below 1 or that is not finite is replaced by 1, an initial delay of 0 by 1 ms.
+    void set_reconnect_policy(const ReconnectPolicy& policy)
+    {
+        _reconnectPolicy = policy;
+        if (!std::isfinite(_reconnectPolicy.multiplier) || !(_reconnectPolicy.multiplier >= 1))
+            _reconnectPolicy.multiplier = 1;
+        if (_reconnectPolicy.initialDelay == 0)
+            _reconnectPolicy.initialDelay = 1; // a delay of 0 could never grow
+        if (_reconnectPolicy.maxDelay < _reconnectPolicy.initialDelay)
+            _reconnectPolicy.maxDelay = _reconnectPolicy.initialDelay;
+        _reconnectBackoff = _reconnectPolicy.initialDelay;
+    }
+
+    const ReconnectPolicy& get_reconnect_policy() const
+    {
+        return _reconnectPolicy;
+    }
+
+    /// Pause (false) or resume (true) automatic (re)connecting in poll().
+    /// A connection attempt that is already in progress is not aborted.
+    void set_auto_reconnect(bool autoReconnect)
+    {
+        _autoReconnect = autoReconnect;
+    }
+
+    bool get_auto_reconnect() const
+    {
+        return _autoReconnect;
+    }
+
+    /// Set automatic resume mode:
+    /// If enabled, the slot is connected again with the last successful ConnectSlot arguments (and updates from
+    /// ConnectUpdate) as soon as RoomInfo of the same room (seed) is received after a reconnect. Queued checks, scouts,
+    /// hints and status are sent once connected. Calling ConnectSlot with the same arguments while resuming does
+    /// nothing, calling it with different arguments connects with those instead.
+    void set_auto_resume(bool autoResume)
+    {
+        _autoResume = autoResume;
+    }
+
+    /// Gets automatic resume mode:
+    /// \sa see set_auto_resume for details.
+    bool get_auto_resume() const
+    {
+        return _autoResume;
+    }
+
     /// Set location sending/receiving mode:
     /// If receiveOwnLocations is set to true, missing and checked locations
     /// won't update until the server acknowledges the LocationChecks and
@@ -638,6 +1131,35 @@ public:
         return _receiveOwnLocations;
     }
 
+    /// Set data storage caching mode:
+    /// If enabled, values received through Retrieved and SetReply are stored locally
+    /// and can be read with get_data_storage_value() without a round trip.
+    /// Use SetNotify to keep keys up to date. The cache is cleared when the room changes.
+    /// Set is applied to cached values of keys in SetNotify right away and skipped if it can't change them.
+    void set_data_storage_cache_enabled(bool enabled)
+    {
+        _dataStorageCacheEnabled = enabled;
+        if (!enabled)
+            _dataStorageCache.clear();
+    }
+
+    /// Gets data storage caching mode:
+    /// \sa see set_data_storage_cache_enabled for details.
+    bool get_data_storage_cache_enabled() const
+    {
+        return _dataStorageCacheEnabled;
+    }
+
+    /// Get a value from the local data storage cache. Returns nullptr if the key is not cached.
+    /// The returned pointer is only valid until the next call to poll().
+    const json* get_data_storage_value(const std::string& key) const
+    {
+        const auto it = _dataStorageCache.find(key);
+        if (it == _dataStorageCache.end())
+            return nullptr;
+        return &it->second;
+    }
+
     std::set<int64_t> get_checked_locations() const
     {
         return _checkedLocations;
@@ -682,6 +1204,102 @@ public:
         return BLANK;
     }
 
+    /// Set data package batching: games are requested in batches of up to batchSize bytes (uncompressed),
+    /// with at most maxInFlight requests outstanding. Sizes are remembered from previous replies or the store.
+    void set_data_package_batching(size_t batchSize, size_t maxInFlight = 2)
+    {
+        _dataPackageBatchSize = batchSize;
+        _dataPackageMaxInFlight = std::max<size_t>(1, maxInFlight);
+    }
+
+    /// Gets data package batch size: \sa see set_data_package_batching
+    size_t get_data_package_batch_size() const
+    {
+        return _dataPackageBatchSize;
+    }
+
+    /// Gets max data package requests in flight: \sa see set_data_package_batching
+    size_t get_data_package_max_in_flight() const
+    {
+        return _dataPackageMaxInFlight;
+    }
+
+    /// Set lazy data package mode: if enabled, games that have a checksum are only loaded from the
+    /// data package store or requested from the server the first time one of their names is looked up.
+    /// Lookups before that return "Unknown", set_game_names_loaded_handler is called once names are available.
+    /// The own game is always loaded right away, so get_item_id and get_location_id work once connected.
+    /// Has to be set before RoomInfo is received.
+    /// NOTE: lookups without a game (get_item_name/get_location_name with an empty game, or nodes of players that
+    ///       are not known) can not tell which game an id belongs to. They only find names of loaded games and
+    ///       return "Unknown" otherwise, unless loadAllForGlobalIds is set. With that, an unknown global id loads
+    ///       every lazy game, which undoes lazy mode for clients that look up such ids.
+    void set_lazy_data_package(bool enable, bool loadAllForGlobalIds = false)
+    {
+        _lazyDataPackage = enable;
+        _lazyLoadAllForGlobalIds = loadAllForGlobalIds;
+    }
+
+    /// Gets lazy data package mode: \sa see set_lazy_data_package
+    bool get_lazy_data_package() const
+    {
+        return _lazyDataPackage;
+    }
+
+    /// Set async data package mode: if enabled, large DataPackage frames are parsed and indexed on a worker thread
+    /// and published by a later poll(). Commands received in the meantime are processed right away, names of the
+    /// new games resolve once published. Has no effect if compiled with AP_NO_THREADS.
+    void set_async_data_package(bool enable)
+    {
+        _asyncDataPackage = enable;
+    }
+
+    /// Gets async data package mode: \sa see set_async_data_package
+    bool get_async_data_package() const
+    {
+        return _asyncDataPackage;
+    }
+
+    /// Set number of threads used to load cached data packages and build the name tables after RoomInfo.
+    /// 0 uses one thread per core, 1 (default) loads on the calling thread. Results do not depend on this.
+    /// Threads are started on first use and kept until the client is destroyed.
+    /// Has no effect if compiled with AP_NO_THREADS.
+    void set_data_package_load_threads(unsigned threads)
+    {
+        _dataPackageLoadThreads = threads;
+    }
+
+    /// Gets number of data package load threads: \sa see set_data_package_load_threads
+    unsigned get_data_package_load_threads() const
+    {
+        return _dataPackageLoadThreads;
+    }
+
+    /// Get the interned id of the game a player is playing, \sa see get_player_game
+    GameId get_player_game_id(const int player) const
+    {
+        if (player == 0)
+            return ARCHIPELAGO_GAME_ID;
+        const auto slotIt = _slotInfo.find(player);
+        if (slotIt != _slotInfo.end())
+            return slotIt->second.gameId;
+        return INVALID_GAME_ID;
+    }
+
+    /// Get the interned id for a game name or INVALID_GAME_ID if the game is not known (yet).
+    /// Games are interned when they appear in RoomInfo, Connected or the data package.
+    GameId get_game_id(const std::string& game) const
+    {
+        const auto it = _gameIds.find(game);
+        return it == _gameIds.end() ? INVALID_GAME_ID : it->second;
+    }
+
+    /// Get the name of an interned game or an empty string
+    const std::string& get_game_name(const GameId game) const
+    {
+        static const std::string BLANK;
+        return game < _gameNames.size() ? _gameNames[game] : BLANK;
+    }
+
     /// Get the currently played game name or an empty string
     const std::string& get_game() const
     {
@@ -694,19 +1312,15 @@ public:
             const auto it = _locations.find(code);
             if (it != _locations.end())
                 return it->second;
-        } else {
-            const static std::string archipelago = "Archipelago";
-            for (const auto& gameLookup : {game, archipelago}) {
-                const auto locationsIt = _gameLocations.find(gameLookup);
-                if (locationsIt != _gameLocations.end()) {
-                    const auto it = locationsIt->second.find(code);
-                    if (it != locationsIt->second.end()) {
-                        return it->second;
-                    }
-                }
-            }
+            request_lazy_games();
+            return "Unknown";
         }
-        return "Unknown";
+        return get_location_name(code, get_game_id(game));
+    }
+
+    std::string get_location_name(const int64_t code, const GameId game) const
+    {
+        return lookup_name_for_game(code, game, false);
     }
 
     /**
@@ -716,6 +1330,7 @@ public:
      */
     int64_t get_location_id(const std::string& name) const
     {
+        request_lazy_game(get_game_id(_game));
         if (_dataPackage["games"].contains(_game)) {
             for (const auto& pair: _dataPackage["games"][_game]["location_name_to_id"].items()) {
                 if (pair.key() == name)
@@ -731,19 +1346,15 @@ public:
             const auto it = _items.find(code);
             if (it != _items.end())
                 return it->second;
-        } else {
-            const static std::string archipelago = "Archipelago";
-            for (const auto& gameLookup : {game, archipelago}) {
-                const auto itemsIt = _gameItems.find(gameLookup);
-                if (itemsIt != _gameItems.end()) {
-                    const auto it = itemsIt->second.find(code);
-                    if (it != itemsIt->second.end()) {
-                        return it->second;
-                    }
-                }
-            }
+            request_lazy_games();
+            return "Unknown";
         }
-        return "Unknown";
+        return get_item_name(code, get_game_id(game));
+    }
+
+    std::string get_item_name(const int64_t code, const GameId game) const
+    {
+        return lookup_name_for_game(code, game, true);
     }
 
     /**
@@ -753,6 +1364,7 @@ public:
      */
     int64_t get_item_id(const std::string& name) const
     {
+        request_lazy_game(get_game_id(_game));
         if (_dataPackage["games"].contains(_game)) {
             for (const auto& pair: _dataPackage["games"][_game]["item_name_to_id"].items()) {
                 if (pair.key() == name)
@@ -776,78 +1388,185 @@ public:
 
     std::string render_json(const std::list<TextNode>& msg, RenderFormat fmt = RenderFormat::TEXT) const
     {
-        // TODO: implement RenderFormat::HTML
-        if (fmt == RenderFormat::HTML)
-            throw std::invalid_argument("AP::render_json(..., HTML) not implemented");
         std::string out;
+        size_t size = 0;
+        for (const auto& node: msg)
+            size += node.text.size();
+        out.reserve(size + size / 2); // names are usually longer than ids, plus some markup
+        render_json(out, msg, fmt);
+        return out;
+    }
+
+    /// Render msg and append it to out. Reserve capacity in out to avoid reallocations.
+    void render_json(std::string& out, const std::list<TextNode>& msg, RenderFormat fmt = RenderFormat::TEXT) const
+    {
         bool colorIsSet = false;
         for (const auto& node: msg) {
-            std::string color;
-            std::string text;
-            if (fmt != RenderFormat::TEXT) color = node.color;
-            if (node.type == "player_id") {
-                int id = std::stoi(node.text);
-                if (color.empty() && slot_concerns_self(id)) color = "magenta";
-                else if (color.empty()) color = "yellow";
-                text = get_player_alias(id);
-            } else if (node.type == "item_id") {
-                int64_t id = stoi64(node.text);
-                if (color.empty()) {
-                    if (node.flags & ItemFlags::FLAG_ADVANCEMENT) color = "plum";
-                    else if (node.flags & ItemFlags::FLAG_NEVER_EXCLUDE) color = "slateblue";
-                    else if (node.flags & ItemFlags::FLAG_TRAP) color = "salmon";
-                    else color = "cyan";
-                }
-                text = get_item_name(id, get_player_game(node.player));
-            } else if (node.type == "location_id") {
-                int64_t id = stoi64(node.text);
-                if (color.empty()) color = "blue";
-                text = get_location_name(id, get_player_game(node.player));
-            } else if (node.type == "hint_status") {
-                text = node.text;
-                if (node.hintStatus == HINT_FOUND) color = "green";
-                else if (node.hintStatus == HINT_UNSPECIFIED) color = "grey";
-                else if (node.hintStatus == HINT_NO_PRIORITY) color = "slateblue";
-                else if (node.hintStatus == HINT_AVOID) color = "salmon";
-                else if (node.hintStatus == HINT_PRIORITY) color = "plum";
-                else color = "red";  // unknown status -> red
-            } else {
-                text = node.text;
-            }
-            if (fmt == RenderFormat::ANSI) {
-                if (color.empty() && colorIsSet) {
-                    out += color2ansi(""); // reset color
-                    colorIsSet = false;
-                } else if (!color.empty()) {
-                    out += color2ansi(color);
-                    colorIsSet = true;
-                }
-                deansify(text);
-                out += text;
-            } else {
-                out += text;
+            TextColor color = node.textColor;
+            if (color == TextColor::NONE && !node.color.empty()) // node was not created by from_json
+                color = parse_text_color(node.color);
+            TextNodeType type = node.nodeType;
+            int64_t id = node.id;
+            if (type == TextNodeType::TEXT && !node.type.empty()) { // node was not created by from_json
+                type = parse_text_node_type(node.type);
+                id = parse_text_node_id(type, node.text);
             }
+            render_node(out, type, color, node.text.data(), node.text.size(), id, node.player, node.flags,
+                        node.hintStatus, fmt, colorIsSet);
         }
-        if (fmt == RenderFormat::ANSI && colorIsSet) out += color2ansi("");
-        return out;
+        if (fmt == RenderFormat::ANSI && colorIsSet) out += color2ansi(TextColor::NONE);
     }
 
-    bool LocationChecks(const std::list<int64_t>& locations)
+    std::string render_json(const TextMessage& msg, RenderFormat fmt = RenderFormat::TEXT) const
     {
-        // returns true if checks were sent or queued
-        if (_state == State::SLOT_CONNECTED) {
-            auto packet = json{{
-                {"cmd", "LocationChecks"},
-                {"locations", locations},
-            }};
+        std::string out;
+        out.reserve(msg.buffer.size() + msg.buffer.size() / 2);
+        render_json(out, msg, fmt);
+        return out;
+    }
 
-            debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-            _ws->send(packet.dump());
-        } else {
-            _checkQueue.insert(locations.begin(), locations.end());
+    /// Render msg and append it to out. Reserve capacity in out to avoid reallocations.
+    void render_json(std::string& out, const TextMessage& msg, RenderFormat fmt = RenderFormat::TEXT) const
+    {
+        bool colorIsSet = false;
+        for (const auto& node: msg.nodes) {
+            render_node(out, node.type, node.color, msg.buffer.data() + node.textOffset, node.textSize, node.id,
+                        node.player, node.flags, node.hintStatus, fmt, colorIsSet);
         }
-        if (!_receiveOwnLocations) {
-            // for receiveOwnLocations, this will be done on the server response instead
+        if (fmt == RenderFormat::ANSI && colorIsSet) out += color2ansi(TextColor::NONE);
+    }
+
+    /// Set memory budget in bytes for the message history of Print and PrintJSON messages.
+    /// Oldest messages are dropped when over budget. 0 disables and clears the history (default).
+    void set_message_history_budget(size_t bytes)
+    {
+        _historyBudget = bytes;
+        if (!bytes)
+            clear_message_history();
+        else
+            trim_history(0);
+    }
+
+    /// Gets message history budget: \sa see set_message_history_budget
+    size_t get_message_history_budget() const
+    {
+        return _historyBudget;
+    }
+
+    /// Get estimated memory used by the message history, including rendered strings
+    size_t get_message_history_memory() const
+    {
+        return _historyMemory;
+    }
+
+    void clear_message_history()
+    {
+        _history.clear();
+        _historyByPlayer.clear();
+        _historyByItem.clear();
+        _historyByType.clear();
+        _historyMemory = 0;
+    }
+
+    /// Get ids of stored messages, oldest first
+    std::vector<uint64_t> get_message_history() const
+    {
+        std::vector<uint64_t> ids;
+        ids.reserve(_history.size());
+        for (const auto& stored: _history)
+            ids.push_back(stored.entry.id);
+        return ids;
+    }
+
+    /// Get ids of stored messages that match filter, oldest first. limit > 0 returns only the newest matches.
+    std::vector<uint64_t> find_message_history(const HistoryFilter& filter, size_t limit = 0) const
+    {
+        // start with the smallest index list, then check the other criteria on the entries
+        const std::deque<uint64_t>* candidates = nullptr;
+        auto narrow = [&candidates](const std::deque<uint64_t>* ids) {
+            if (!candidates || ids->size() < candidates->size())
+                candidates = ids;
+        };
+        static const std::deque<uint64_t> none;
+        if (filter.player >= 0) {
+            auto it = _historyByPlayer.find(filter.player);
+            narrow(it == _historyByPlayer.end() ? &none : &it->second);
+        }
+        if (filter.item != INVALID_NAME_ID) {
+            auto it = _historyByItem.find(filter.item);
+            narrow(it == _historyByItem.end() ? &none : &it->second);
+        }
+        if (!filter.type.empty()) {
+            auto it = _historyByType.find(filter.type);
+            narrow(it == _historyByType.end() ? &none : &it->second);
+        }
+        std::vector<uint64_t> ids;
+        if (!candidates) {
+            ids = get_message_history();
+        } else {
+            for (auto id: *candidates) {
+                const auto& stored = *find_history_entry(id);
+                if (filter.player >= 0 && !stored.players.count(filter.player))
+                    continue;
+                if (filter.item != INVALID_NAME_ID && !stored.items.count(filter.item))
+                    continue;
+                if (!filter.type.empty() && stored.entry.type != filter.type)
+                    continue;
+                ids.push_back(id);
+            }
+        }
+        if (limit && ids.size() > limit)
+            ids.erase(ids.begin(), ids.end() - static_cast<std::ptrdiff_t>(limit));
+        return ids;
+    }
+
+    /// Get a stored message or nullptr if it was dropped. The pointer is valid until the next poll(),
+    /// render_message_history_entry() or set_message_history_budget(), since those may drop messages.
+    const HistoryEntry* get_message_history_entry(uint64_t id) const
+    {
+        const auto stored = find_history_entry(id);
+        return stored ? &stored->entry : nullptr;
+    }
+
+    /// Render a stored message. Rendering happens on first use and is repeated only if names changed.
+    /// Returns an empty string if the message was dropped.
+    std::string render_message_history_entry(uint64_t id, RenderFormat fmt = RenderFormat::TEXT)
+    {
+        auto stored = find_history_entry(id);
+        if (!stored)
+            return "";
+        auto& memo = stored->rendered[static_cast<size_t>(fmt)];
+        if (memo.generation != _renderGeneration || !memo.valid) {
+            const auto oldSize = estimate_size(memo.text);
+            memo.text.clear();
+            render_json(memo.text, stored->entry.data, fmt);
+            memo.text.shrink_to_fit();
+            memo.valid = true;
+            memo.generation = _renderGeneration;
+            _historyMemory = _historyMemory - oldSize + estimate_size(memo.text);
+            std::string text = memo.text; // trimming may drop the entry
+            trim_history(id);
+            return text;
+        }
+        return memo.text;
+    }
+
+    bool LocationChecks(const std::list<int64_t>& locations)
+    {
+        // returns true if checks were sent or queued
+        if (_state == State::SLOT_CONNECTED) {
+            auto packet = json{{
+                {"cmd", "LocationChecks"},
+                {"locations", locations},
+            }};
+
+            debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
+            send_packet(packet);
+        } else {
+            _checkQueue.insert(locations.begin(), locations.end());
+        }
+        if (!_receiveOwnLocations) {
+            // for receiveOwnLocations, this will be done on the server response instead
             for (const auto& location: locations) {
                 _checkedLocations.insert(location);
                 _missingLocations.erase(location);
@@ -867,7 +1586,9 @@ public:
             }};
 
             debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-            _ws->send(packet.dump());
+            send_packet(packet);
+            // LocationInfo replies arrive in order, locations tell if a scout was skipped
+            _pendingScouts.push_back({now(), 0, nullptr, std::set<int64_t>(locations.begin(), locations.end())});
         } else {
             _scoutQueues[create_as_hint].insert(locations.begin(), locations.end());
         }
@@ -889,7 +1610,7 @@ public:
             }};
 
             debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-            _ws->send(packet.dump());
+            send_packet(packet);
         } else {
             _updateHintQueue.emplace_back(player, location, status);
         }
@@ -919,7 +1640,7 @@ public:
             }
 
             debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-            _ws->send(packet.dump());
+            send_packet(packet);
         }
         else {
             _createHintsQueueByPlayerAndStatus[{target_player, hint_status}].insert(locations.begin(), locations.end());
@@ -938,7 +1659,7 @@ public:
             }};
 
             debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-            _ws->send(packet.dump());
+            send_packet(packet);
             return true;
         }
 
@@ -952,6 +1673,12 @@ public:
         if (_state < State::SOCKET_CONNECTED)
             return false;
 
+        if (_resuming && name == _resume.name && password == _resume.password &&
+                items_handling == _resume.itemsHandling && tags == _resume.tags && ver == _resume.version)
+            return true; // automatic resume is already connecting this slot
+
+        _resume = {name, password, items_handling, tags, ver, _seed};
+        _resumeValid = false; // until Connected
         _slot = name;
         debug("Connecting slot...");
         auto packet = json{{
@@ -966,7 +1693,26 @@ public:
         }};
 
         debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-        _ws->send(packet.dump());
+        send_packet(packet);
+        _pendingConnects.push_back({now(), 0, "Connected", nullptr}); // Connected/ConnectionRefused arrive in order
+        return true;
+    }
+
+    /**
+     * Send ConnectSlot and call cb exactly once, either with the Connected or ConnectionRefused command
+     * or with success = false and null on timeout or disconnect. The slot connected/refused handlers are still called.
+     * timeout is in milliseconds, 0 to wait forever.
+     * Returns false and does not call cb if the request could not be sent.
+     */
+    bool connect_slot_async(const std::string& name, const std::string& password, int items_handling,
+                            const std::list<std::string>& tags, const Version& ver,
+                            std::function<void(bool success, const json& reply)> cb, unsigned long timeout = 0)
+    {
+        if (!ConnectSlot(name, password, items_handling, tags, ver))
+            return false;
+        auto& pending = _pendingConnects.back();
+        pending.timeout = timeout;
+        pending.cb = std::move(cb);
         return true;
     }
 
@@ -992,6 +1738,10 @@ public:
         if (!send_items_handling && !send_tags)
             return false;
 
+        // remember for automatic resume
+        if (send_items_handling) _resume.itemsHandling = items_handling;
+        if (send_tags) _resume.tags = tags;
+
         auto packet = json{{
             {"cmd", "ConnectUpdate"},
         }};
@@ -1000,7 +1750,7 @@ public:
         if (send_tags) packet[0]["tags"] = tags;
 
         debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-        _ws->send(packet.dump());
+        send_packet(packet);
         return true;
     }
 
@@ -1014,7 +1764,7 @@ public:
         }};
 
         debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-        _ws->send(packet.dump());
+        send_packet(packet);
         return true;
     }
 
@@ -1034,28 +1784,24 @@ public:
         }
 
         // optimized data package fetching:
-        // fetch in multiple packets for better streaming / less blocking
-        // fetch in at least 2 steps if more than 1 game needs to be fetched
-        // prefer to fetch 2 games at once for better use of compression window
-        // if it's an odd number, the last fetch should be 1 game
-        size_t n = 0;
-        const size_t count = include.size();
+        // fetch in multiple packets for better streaming / less blocking, packing games up to the batch size
+        // using remembered sizes; better use of compression window than single games, with a bounded number
+        // of requests in flight
         std::vector<std::string> games;
+        size_t batchSize = 0;
         for (const auto& game: include) {
-            games.push_back(game);
-            n++;
-            if (count > 2 && n != count && (n % 2) != 0) {
-                continue;
+            const size_t size = get_data_package_size_estimate(game);
+            if (!games.empty() && batchSize + size > _dataPackageBatchSize) {
+                _dataPackageBatches.push_back(std::move(games));
+                games.clear();
+                batchSize = 0;
             }
-            auto packet = json{{
-                {"cmd", "GetDataPackage"},
-                {"games", games}, // since 0.3.2
-            }};
-            debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-            _ws->send(packet.dump());
-            _pendingDataPackageRequests++;
-            games.clear();
+            games.push_back(game);
+            batchSize += size;
         }
+        if (!games.empty())
+            _dataPackageBatches.push_back(std::move(games));
+        send_data_package_batches();
 
         return true;
     }
@@ -1081,7 +1827,7 @@ public:
         if (dump.size() > maxDumpLen-3) dump = dump.substr(0, maxDumpLen-3) + "...";
         debug("> " + packet[0]["cmd"].get<std::string>() + ": " + dump);
 #endif
-        _ws->send(packet.dump());
+        send_packet(packet);
         return true;
     }
 
@@ -1095,7 +1841,7 @@ public:
             {"text", text},
         }};
         debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-        _ws->send(packet.dump());
+        send_packet(packet);
 
         return true;
     }
@@ -1105,17 +1851,7 @@ public:
         if (_state < State::SLOT_CONNECTED)
             return false;
 
-        auto packet = json{{
-            {"cmd", "Get"},
-            {"keys", keys},
-        }};
-
-        if (!extras.is_null())
-            packet[0].update(extras);
-
-        debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-        _ws->send(packet.dump());
-        return true;
+        return send_get(keys, extras);
     }
 
     bool Set(const std::string& key, const json& dflt, bool want_reply,
@@ -1124,6 +1860,29 @@ public:
         if (_state < State::SLOT_CONNECTED)
             return false;
 
+        if (_dataStorageCacheEnabled && _notifiedKeys.count(key)) {
+            // apply optimistically, SetReply will correct the value if it was changed in the meantime.
+            // Values of keys that are not in SetNotify may be stale and no SetReply would correct them.
+            auto it = _dataStorageCache.find(key);
+            if (it != _dataStorageCache.end()) {
+                if (!want_reply && (extras.is_null() || extras.empty()) && !it->second.is_null()
+                        && std::all_of(operations.begin(), operations.end(), is_noop_data_storage_operation)) {
+                    debug("Skipping Set for " + key + ": no-op");
+                    return true;
+                }
+                try {
+                    update_data_storage_cache(key, apply_data_storage_operations(it->second, dflt, operations));
+                } catch (const std::exception& ex) {
+                    debug(std::string("Could not apply Set locally: ") + ex.what());
+                }
+            }
+        }
+
+        if (_dataStorageWriteBatching) {
+            queue_set(key, dflt, want_reply, operations, extras);
+            return true;
+        }
+
         auto packet = json{{
            {"cmd", "Set"},
            {"key", key},
@@ -1136,7 +1895,54 @@ public:
             packet[0].update(extras);
 
         debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-        _ws->send(packet.dump());
+        send_packet(packet);
+        return true;
+    }
+
+    /// Set data storage write batching mode:
+    /// If enabled, Set is queued and consecutive writes to the same key without want_reply and extras are merged,
+    /// i.e. `add`s are summed up and a `replace` discards previous operations.
+    /// Queued writes are sent in a single packet from poll(), at most every flushInterval milliseconds,
+    /// or right before any other command, so commands still reach the server in the order they were made.
+    void set_data_storage_write_batching(bool enabled, unsigned long flushInterval = 0)
+    {
+        if (!enabled)
+            flush_data_storage_writes();
+        _dataStorageWriteBatching = enabled;
+        _dataStorageFlushInterval = flushInterval;
+    }
+
+    /// Gets data storage write batching mode:
+    /// \sa see set_data_storage_write_batching for details.
+    bool get_data_storage_write_batching() const
+    {
+        return _dataStorageWriteBatching;
+    }
+
+    /// Send queued data storage writes now. Returns false if there was nothing to send or not connected.
+    bool flush_data_storage_writes()
+    {
+        if (_state < State::SLOT_CONNECTED || _pendingSets.empty())
+            return false;
+
+        auto packet = json(json::value_t::array);
+        for (auto& pending: _pendingSets) {
+            auto command = json{
+                {"cmd", "Set"},
+                {"key", std::move(pending.key)},
+                {"default", std::move(pending.dflt)},
+                {"want_reply", pending.wantReply},
+                {"operations", pending.operations},
+            };
+            if (!pending.extras.is_null())
+                command.update(pending.extras);
+            packet.push_back(std::move(command));
+        }
+        _pendingSets.clear();
+        _lastDataStorageFlush = now();
+
+        debug("> Set: " + packet.dump());
+        send_packet(packet);
         return true;
     }
 
@@ -1151,10 +1957,309 @@ public:
         }};
 
         debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
-        _ws->send(packet.dump());
+        send_packet(packet);
+        _notifiedKeys.insert(keys.begin(), keys.end());
+        return true;
+    }
+
+    /**
+     * Subscribe to data storage keys on behalf of subscriber.
+     * Keys are reference counted across subscribers. Keys that are not subscribed yet are sent in a single SetNotify
+     * and fetched with a single Get. After (re)connecting the slot, all subscribed keys are subscribed and fetched
+     * again. If the data storage cache is enabled, the values end up in the cache (and the retrieved handler is not
+     * called), otherwise the retrieved handler is called.
+     */
+    void subscribe_data_storage(const std::string& subscriber, const std::list<std::string>& keys)
+    {
+        auto& subscribed = _dataStorageSubscribers[subscriber];
+        std::list<std::string> newKeys;
+        for (const auto& key: keys) {
+            if (!subscribed.insert(key).second)
+                continue; // already subscribed by this subscriber
+            if (_dataStorageSubscriptions[key]++ == 0 && !_notifiedKeys.count(key))
+                newKeys.push_back(key);
+        }
+        if (!newKeys.empty() && _state == State::SLOT_CONNECTED)
+            send_data_storage_subscriptions(newKeys);
+    }
+
+    /// Remove subscriber's subscription of keys. The server will still send updates until reconnect.
+    void unsubscribe_data_storage(const std::string& subscriber, const std::list<std::string>& keys)
+    {
+        auto it = _dataStorageSubscribers.find(subscriber);
+        if (it == _dataStorageSubscribers.end())
+            return;
+        for (const auto& key: keys) {
+            if (it->second.erase(key))
+                release_data_storage_subscription(key);
+        }
+        if (it->second.empty())
+            _dataStorageSubscribers.erase(it);
+    }
+
+    /// Remove all of subscriber's subscriptions. The server will still send updates until reconnect.
+    void unsubscribe_data_storage(const std::string& subscriber)
+    {
+        auto it = _dataStorageSubscribers.find(subscriber);
+        if (it == _dataStorageSubscribers.end())
+            return;
+        for (const auto& key: it->second)
+            release_data_storage_subscription(key);
+        _dataStorageSubscribers.erase(it);
+    }
+
+    /// Get all data storage keys that have at least one subscriber.
+    std::set<std::string> get_data_storage_subscriptions() const
+    {
+        std::set<std::string> keys;
+        for (const auto& pair: _dataStorageSubscriptions)
+            keys.insert(keys.end(), pair.first);
+        return keys;
+    }
+
+    /**
+     * Send Get and call cb exactly once, either with the retrieved keys or with success = false on timeout or
+     * disconnect. The reply is not passed to the retrieved handler. timeout is in milliseconds, 0 to wait forever.
+     * Returns false and does not call cb if the request could not be sent.
+     */
+    bool get_async(const std::list<std::string>& keys,
+                   std::function<void(bool success, const json& keys)> cb, unsigned long timeout = 0)
+    {
+        if (_state < State::SLOT_CONNECTED)
+            return false;
+        return start_get_request(keys, std::move(cb), timeout);
+    }
+
+    /**
+     * Send Set with want_reply and call cb exactly once, either with the SetReply command or with success = false
+     * on timeout or disconnect. timeout is in milliseconds, 0 to wait forever.
+     * The SetReply is also passed to the set_reply handler, since it is a SetNotify notification as well.
+     * Returns false and does not call cb if the request could not be sent.
+     */
+    bool set_async(const std::string& key, const json& dflt, const std::list<DataStorageOperation>& operations,
+                   std::function<void(bool success, const json& reply)> cb, unsigned long timeout = 0)
+    {
+        if (_state < State::SLOT_CONNECTED)
+            return false;
+        const uint64_t id = _nextRequestId++;
+        if (!Set(key, dflt, true, operations, request_tag(id)))
+            return false;
+        _pendingRequests[id] = {now(), timeout, "SetReply", std::move(cb)};
+        return true;
+    }
+
+    /**
+     * Send LocationScouts and call cb exactly once, either with the scouted items or with success = false on
+     * timeout, disconnect or if the server rejected the request. The reply is not passed to the location info
+     * handler. timeout is in milliseconds, 0 to wait forever.
+     * Replies are matched by order and locations; a scout that gets no reply fails once a later one is answered.
+     * Returns false and does not call cb if the request could not be sent.
+     */
+    bool scout_async(const std::list<int64_t>& locations, int create_as_hint,
+                     std::function<void(bool success, const std::list<NetworkItem>& items)> cb,
+                     unsigned long timeout = 0)
+    {
+        if (_state < State::SLOT_CONNECTED)
+            return false;
+        if (!LocationScouts(locations, create_as_hint))
+            return false;
+        auto& pending = _pendingScouts.back();
+        pending.timeout = timeout;
+        pending.cb = std::move(cb);
         return true;
     }
 
+    /**
+     * Apply data storage operations locally, the same way the server does for Set.
+     * value is the current value of the key, or null if the key does not exist, in which case dflt is used.
+     * Throws std::invalid_argument if an operation is unknown or can not be applied to the value.
+     */
+    static json apply_data_storage_operations(const json& value, const json& dflt,
+                                              const std::list<DataStorageOperation>& operations)
+    {
+        json res = value.is_null() ? dflt : value;
+        for (const auto& op: operations)
+            apply_data_storage_operation(res, op);
+        return res;
+    }
+
+    /**
+     * Apply a single data storage operation to value in place.
+     * Throws std::invalid_argument if the operation is unknown or can not be applied to the value.
+     */
+    static void apply_data_storage_operation(json& value, const DataStorageOperation& op)
+    {
+        const std::string& operation = op.operation;
+        const json& arg = op.value;
+        if (operation == "replace") {
+            value = arg;
+        } else if (operation == "default") {
+            // keeps the current value
+        } else if (operation == "add") {
+            if (value.is_number() && arg.is_number()) {
+                if (is_integer(value) && is_integer(arg)) {
+                    const int64_t a = value.get<int64_t>();
+                    const int64_t b = arg.get<int64_t>();
+                    if ((b > 0 && a > std::numeric_limits<int64_t>::max() - b) ||
+                            (b < 0 && a < std::numeric_limits<int64_t>::min() - b))
+                        value = static_cast<double>(a) + static_cast<double>(b);
+                    else
+                        value = a + b;
+                } else {
+                    value = value.get<double>() + arg.get<double>();
+                }
+            } else if (value.is_array() && arg.is_array()) {
+                value.insert(value.end(), arg.begin(), arg.end());
+            } else if (value.is_string() && arg.is_string()) {
+                value = value.get<std::string>() + arg.get<std::string>();
+            } else {
+                throw_invalid_operation(op, value);
+            }
+        } else if (operation == "mul") {
+            require_numbers(op, value);
+            if (is_integer(value) && is_integer(arg)) {
+                const int64_t a = value.get<int64_t>();
+                const int64_t b = arg.get<int64_t>();
+                const double d = static_cast<double>(a) * static_cast<double>(b);
+                if (d >= -9.2e18 && d <= 9.2e18)
+                    value = a * b;
+                else
+                    value = d;
+            } else {
+                value = value.get<double>() * arg.get<double>();
+            }
+        } else if (operation == "pow") {
+            require_numbers(op, value);
+            if (is_integer(value) && is_integer(arg) && arg.get<int64_t>() >= 0) {
+                int64_t base = value.get<int64_t>();
+                int64_t exp = arg.get<int64_t>();
+                int64_t res = 1;
+                bool overflow = false;
+                if (base == 0 || base == 1) {
+                    res = (exp == 0) ? 1 : base;
+                } else if (base == -1) {
+                    res = (exp % 2) ? -1 : 1;
+                } else {
+                    // square-and-multiply, |base| >= 2 overflows after at most 63 steps
+                    auto mul = [&overflow](int64_t a, int64_t b) {
+                        const double d = static_cast<double>(a) * static_cast<double>(b);
+                        overflow = overflow || d < -9.2e18 || d > 9.2e18;
+                        return overflow ? a : a * b;
+                    };
+                    while (exp > 0 && !overflow) {
+                        if (exp & 1)
+                            res = mul(res, base);
+                        exp >>= 1;
+                        if (exp > 0)
+                            base = mul(base, base);
+                    }
+                }
+                if (overflow)
+                    value = std::pow(value.get<double>(), arg.get<double>());
+                else
+                    value = res;
+            } else {
+                value = std::pow(value.get<double>(), arg.get<double>());
+            }
+        } else if (operation == "mod") {
+            require_numbers(op, value);
+            if (is_integer(value) && is_integer(arg)) {
+                const int64_t a = value.get<int64_t>();
+                const int64_t b = arg.get<int64_t>();
+                if (b == 0)
+                    throw_invalid_operation(op, value);
+                int64_t res = (b == -1) ? 0 : a % b;
+                if (res != 0 && ((res < 0) != (b < 0)))
+                    res += b; // sign follows the divisor
+                value = res;
+            } else {
+                const double b = arg.get<double>();
+                if (b == 0)
+                    throw_invalid_operation(op, value);
+                double res = std::fmod(value.get<double>(), b);
+                if (res != 0 && ((res < 0) != (b < 0)))
+                    res += b;
+                value = res;
+            }
+        } else if (operation == "floor" || operation == "ceil") {
+            if (!value.is_number())
+                throw_invalid_operation(op, value);
+            if (!is_integer(value)) {
+                const double d = value.get<double>();
+                const double res = operation == "floor" ? std::floor(d) : std::ceil(d);
+                if (res >= -9.2e18 && res <= 9.2e18)
+                    value = static_cast<int64_t>(res);
+                else
+                    value = res; // out of range, inf or nan
+            }
+        } else if (operation == "max" || operation == "min") {
+            require_numbers(op, value);
+            const bool isMax = operation == "max";
+            bool takeArg;
+            if (is_integer(value) && is_integer(arg))
+                takeArg = isMax ? arg.get<int64_t>() > value.get<int64_t>() : arg.get<int64_t>() < value.get<int64_t>();
+            else
+                takeArg = isMax ? arg.get<double>() > value.get<double>() : arg.get<double>() < value.get<double>();
+            if (takeArg)
+                value = arg;
+        } else if (operation == "and" || operation == "or" || operation == "xor" ||
+                   operation == "left_shift" || operation == "right_shift") {
+            if (!is_integer(value) || !is_integer(arg))
+                throw_invalid_operation(op, value);
+            const int64_t a = value.get<int64_t>();
+            const int64_t b = arg.get<int64_t>();
+            if (operation == "and") {
+                value = a & b;
+            } else if (operation == "or") {
+                value = a | b;
+            } else if (operation == "xor") {
+                value = a ^ b;
+            } else if (b < 0) {
+                throw_invalid_operation(op, value);
+            } else if (operation == "left_shift") {
+                const int64_t res = (b >= 63) ? 0 : static_cast<int64_t>(static_cast<uint64_t>(a) << b);
+                if (a != 0 && (b >= 63 || (res >> b) != a))
+                    value = std::ldexp(static_cast<double>(a), static_cast<int>(std::min<int64_t>(b, 1024)));
+                else
+                    value = res;
+            } else {
+                value = (b >= 63) ? (a < 0 ? -1 : 0) : (a >> b);
+            }
+        } else if (operation == "remove") {
+            if (!value.is_array())
+                throw_invalid_operation(op, value);
+            auto it = std::find(value.begin(), value.end(), arg);
+            if (it != value.end())
+                value.erase(it);
+        } else if (operation == "pop") {
+            if (value.is_array() && is_integer(arg)) {
+                int64_t index = arg.get<int64_t>();
+                const auto size = static_cast<int64_t>(value.size());
+                if (index < 0)
+                    index += size;
+                if (index >= 0 && index < size)
+                    value.erase(static_cast<size_t>(index));
+            } else if (value.is_object() && arg.is_string()) {
+                value.erase(arg.get<std::string>());
+            } else {
+                throw_invalid_operation(op, value);
+            }
+        } else if (operation == "update") {
+            if (value.is_object() && arg.is_object()) {
+                value.update(arg);
+            } else if (value.is_array() && arg.is_array()) {
+                for (const auto& entry: arg) {
+                    if (std::find(value.begin(), value.end(), entry) == value.end())
+                        value.push_back(entry);
+                }
+            } else {
+                throw_invalid_operation(op, value);
+            }
+        } else {
+            throw std::invalid_argument("Unknown data storage operation " + operation);
+        }
+    }
+
     State get_state() const
     {
         return _state;
@@ -1223,11 +2328,157 @@ public:
     }
 
     /// Get the estimated server Unix time stamp as double. Useful to filter deathlink
+    /// If clock sync is enabled, this is corrected for the latency of the RoomInfo packet.
     double get_server_time() const
     {
         auto td = std::chrono::duration<double>(
             std::chrono::steady_clock::now() - _localConnectTime);
-        return _serverConnectTime + td.count();
+        const double rtt = get_min_rtt();
+        return _serverConnectTime + td.count() + (rtt > 0 ? rtt / 2 : 0);
+    }
+
+    /// Get the smoothed round trip time to the server in seconds, or a negative value if not measured yet.
+    /// \sa see set_clock_sync_interval
+    double get_rtt() const
+    {
+        return _rtt;
+    }
+
+    /// Get the maximum error of get_server_time() in seconds, or a negative value if unknown.
+    /// \sa see set_clock_sync_interval
+    double get_server_time_uncertainty() const
+    {
+        const double rtt = get_min_rtt();
+        return rtt > 0 ? rtt / 2 : -1;
+    }
+
+    /// Get a snapshot of runtime metrics
+    Metrics get_metrics() const
+    {
+        Metrics metrics = _metrics;
+        metrics.checkQueue = _checkQueue.size();
+        metrics.scoutQueue = 0;
+        for (const auto& pair: _scoutQueues)
+            metrics.scoutQueue += pair.second.size();
+        metrics.updateHintQueue = _updateHintQueue.size();
+        return metrics;
+    }
+
+    /// Get runtime metrics in OpenMetrics text format
+    std::string get_metrics_openmetrics() const
+    {
+        const auto metrics = get_metrics();
+        std::string out;
+        auto header = [&out](const char* name, const char* type, const char* help) {
+            out += std::string("# TYPE apclient_") + name + " " + type + "\n";
+            out += std::string("# HELP apclient_") + name + " " + help + "\n";
+        };
+        auto value = [&out](const std::string& name, const std::string& labels, double v) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.17g", v);
+            out += "apclient_" + name + (labels.empty() ? "" : "{" + labels + "}") + " " + buf + "\n";
+        };
+        auto label = [](const char* key, const std::string& val) {
+            std::string escaped;
+            for (char c: val) {
+                if (c == '\\' || c == '"') escaped += '\\';
+                if (c == '\n') escaped += "\\n";
+                else escaped += c;
+            }
+            return std::string(key) + "=\"" + escaped + "\"";
+        };
+        // canonical float text: shortest that reads back as the same value, ".0" for integral values, e.g. le="1.0"
+        auto canonical = [](double v) {
+            if (std::isinf(v))
+                return std::string(v > 0 ? "+Inf" : "-Inf");
+            if (std::isnan(v))
+                return std::string("NaN");
+            const bool fixed = v == 0 || (std::fabs(v) >= 1e-4 && std::fabs(v) < 1e15); // like %g, but 10 is 10
+            char buf[48];
+            for (int precision = fixed ? 0 : 1; precision <= (fixed ? 21 : 17); precision++) {
+                snprintf(buf, sizeof(buf), fixed ? "%.*f" : "%.*g", precision, v);
+                if (strtod(buf, nullptr) == v)
+                    break;
+            }
+            std::string res = buf;
+            if (res.find_first_of(".e") == std::string::npos)
+                res += ".0";
+            return res;
+        };
+        auto histogram = [&value, &label, &canonical](const std::string& name, const std::string& labels,
+                                                      const Histogram& h) {
+            const std::string prefix = labels.empty() ? labels : labels + ",";
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < h.counts.size(); i++) {
+                const std::string le = i < h.bounds.size() ? canonical(h.bounds[i]) : "+Inf";
+                cumulative += h.counts[i];
+                value(name + "_bucket", prefix + label("le", le), static_cast<double>(cumulative));
+            }
+            value(name + "_sum", labels, h.sum);
+            value(name + "_count", labels, static_cast<double>(h.count));
+        };
+
+        header("sent_bytes", "counter", "Bytes sent.");
+        value("sent_bytes_total", "", static_cast<double>(metrics.bytesSent));
+        header("received_bytes", "counter", "Bytes received.");
+        value("received_bytes_total", "", static_cast<double>(metrics.bytesReceived));
+        header("sent_frames", "counter", "Websocket frames sent.");
+        value("sent_frames_total", "", static_cast<double>(metrics.framesSent));
+        header("received_frames", "counter", "Websocket frames received.");
+        value("received_frames_total", "", static_cast<double>(metrics.framesReceived));
+        header("sent_commands", "counter", "Commands sent by cmd.");
+        for (const auto& pair: metrics.commandsSent)
+            value("sent_commands_total", label("cmd", pair.first), static_cast<double>(pair.second));
+        header("received_commands", "counter", "Commands received by cmd.");
+        for (const auto& pair: metrics.commandsReceived)
+            value("received_commands_total", label("cmd", pair.first), static_cast<double>(pair.second));
+        header("parse_seconds", "histogram", "Time spent parsing received frames.");
+        histogram("parse_seconds", "", metrics.parseTime);
+        header("validation_seconds", "histogram", "Time spent validating received frames.");
+        histogram("validation_seconds", "", metrics.validationTime);
+        header("handler_seconds", "histogram", "Time spent handling received commands, including callbacks.");
+        for (const auto& pair: metrics.handlerTime)
+            histogram("handler_seconds", label("cmd", pair.first), pair.second);
+        header("check_queue", "gauge", "Queued location checks.");
+        value("check_queue", "", static_cast<double>(metrics.checkQueue));
+        header("scout_queue", "gauge", "Queued location scouts.");
+        value("scout_queue", "", static_cast<double>(metrics.scoutQueue));
+        header("update_hint_queue", "gauge", "Queued hint updates.");
+        value("update_hint_queue", "", static_cast<double>(metrics.updateHintQueue));
+        header("connect_attempts", "counter", "Socket connection attempts.");
+        value("connect_attempts_total", "", static_cast<double>(metrics.connectAttempts));
+        header("reconnects", "counter", "Connection attempts after a connection was lost.");
+        value("reconnects_total", "", static_cast<double>(metrics.reconnects));
+        header("time_to_connected_seconds", "histogram", "Time from first connection attempt to slot connected.");
+        histogram("time_to_connected_seconds", "", metrics.timeToConnected);
+        out += "# EOF\n";
+        return out;
+    }
+
+    /// Set how often the round trip time is measured while the slot is connected, in milliseconds. 0 to disable.
+    /// The server only sends its time in RoomInfo, so measurements are used to estimate how old that time stamp
+    /// was when it arrived, which improves get_server_time().
+    void set_clock_sync_interval(unsigned long interval)
+    {
+        _clockSyncInterval = interval;
+    }
+
+    unsigned long get_clock_sync_interval() const
+    {
+        return _clockSyncInterval;
+    }
+
+    /// Set how long the server may be silent before the connection is considered dead, in milliseconds. 0 to disable.
+    /// Only applies while the slot is connected, since the server can not be probed before that. A cheap request is
+    /// sent after half of the time to make the server reply. A dead connection is closed and reconnected immediately.
+    void set_liveness_timeout(unsigned long timeout)
+    {
+        _livenessTimeout = timeout;
+    }
+
+    unsigned long get_liveness_timeout() const
+    {
+        return _livenessTimeout;
     }
 
     /// Get the version of the server currently connected to
@@ -1248,11 +2499,33 @@ public:
      */
     void poll()
     {
-        if (_ws && _state == State::DISCONNECTED)
+        _wsRetired.clear();
+        if (_ws && _state == State::DISCONNECTED) {
             _ws.reset();
+            _wsRace.reset();
+        }
         if (_ws)
             _ws->poll();
-        if (_state < State::SOCKET_CONNECTED) {
+        if (_wsRace)
+            _wsRace->poll();
+        if (_raceStartPending && static_cast<unsigned long>(now() - _lastSocketConnect) >= SCHEME_RACE_HEAD_START)
+            start_race();
+#ifndef AP_NO_THREADS
+        if (!_dataPackageJobs.empty())
+            publish_data_packages();
+#endif
+        check_request_timeouts();
+        if (!_lazyLoadQueue.empty() && _state >= State::ROOM_INFO)
+            load_lazy_games();
+        if (_clockSyncInterval && _state == State::SLOT_CONNECTED && !_rttProbePending &&
+                static_cast<unsigned long>(now() - _lastRttProbe) >= _clockSyncInterval)
+            send_rtt_probe();
+        if (_livenessTimeout && _state == State::SLOT_CONNECTED)
+            check_liveness();
+        if (!_pendingSets.empty() && _state == State::SLOT_CONNECTED &&
+                static_cast<unsigned long>(now() - _lastDataStorageFlush) >= _dataStorageFlushInterval)
+            flush_data_storage_writes();
+        if (_state < State::SOCKET_CONNECTED && _autoReconnect) {
             auto t = now();
             if (_reconnectNow || static_cast<unsigned long>(t - _lastSocketConnect) > _socketReconnectInterval) {
                 if (_state != State::DISCONNECTED)
@@ -1264,6 +2537,54 @@ public:
         }
     }
 
+    /// Get the time in milliseconds until poll() has timed work to do (reconnect, timeouts, flushing, probes),
+    /// 0 if work is due now or ULONG_MAX if nothing is scheduled.
+    /// NOTE: wswrap does not expose the underlying socket, so while a socket exists, incoming data is only
+    ///       processed by poll(). Sleep for at most min(next_wakeup(), acceptable latency) in that case.
+    unsigned long next_wakeup() const
+    {
+        const auto t = now();
+        unsigned long wakeup = std::numeric_limits<unsigned long>::max();
+        auto schedule = [&wakeup, t](unsigned long start, unsigned long interval) {
+            const auto elapsed = static_cast<unsigned long>(t - start);
+            wakeup = std::min(wakeup, elapsed >= interval ? 0 : interval - elapsed);
+        };
+        if (_ws && _state == State::DISCONNECTED)
+            return 0;
+        if (!_lazyLoadQueue.empty() && _state >= State::ROOM_INFO)
+            return 0;
+#ifndef AP_NO_THREADS
+        if (!_dataPackageJobs.empty())
+            wakeup = ASYNC_DATA_PACKAGE_POLL_INTERVAL; // parsing, can not be waited for from outside
+#endif
+        for (const auto& pair: _pendingRequests) {
+            if (pair.second.timeout)
+                schedule(pair.second.start, pair.second.timeout);
+        }
+        for (const auto& pending: _pendingConnects) {
+            if (pending.cb && pending.timeout)
+                schedule(pending.start, pending.timeout);
+        }
+        for (const auto& pending: _pendingScouts) {
+            if (pending.cb && pending.timeout)
+                schedule(pending.start, pending.timeout);
+        }
+        if (_clockSyncInterval && _state == State::SLOT_CONNECTED && !_rttProbePending)
+            schedule(_lastRttProbe, _clockSyncInterval);
+        if (_livenessTimeout && _state == State::SLOT_CONNECTED) {
+            schedule(_lastReceive, _livenessTimeout);
+            if (!_rttProbePending)
+                schedule(_lastReceive, _livenessTimeout / 2);
+        }
+        if (!_pendingSets.empty() && _state == State::SLOT_CONNECTED)
+            schedule(_lastDataStorageFlush, _dataStorageFlushInterval);
+        if (_raceStartPending)
+            schedule(_lastSocketConnect, SCHEME_RACE_HEAD_START);
+        if (_state < State::SOCKET_CONNECTED && _autoReconnect)
+            schedule(_lastSocketConnect, _reconnectNow ? 0 : _socketReconnectInterval + 1);
+        return wakeup;
+    }
+
     /// Clear all state and reconnect on next poll
     void reset()
     {
@@ -1280,15 +2601,30 @@ public:
         _hintCostPercent = 0;
         _hintPoints = 0;
         _players.clear();
+        _renderGeneration++;
+        update_slot_names();
         _ws.reset();
+        _wsRace.reset();
+        _raceStartPending = false;
         _state = State::DISCONNECTED;
         _hasPassword = false;
+        _dataStorageCache.clear();
+        _pendingSets.clear();
+        _lazyGames.clear();
+        _lazyLoadQueue.clear();
+        _resume = {};
+        _resumeValid = false;
+        _resuming = false;
+        fail_pending_requests();
     }
 
 private:
     void log(const char* msg)
     {
-        printf("APClient: %s\n", msg);
+        if (_hOnLog)
+            _hOnLog(msg);
+        else
+            printf("APClient: %s\n", msg);
     }
 
     void log(const std::string& msg)
@@ -1310,51 +2646,147 @@ private:
         debug(msg.c_str());
     }
 
-    void onopen()
+    void onopen(unsigned id)
     {
+        if (id == _wsRaceId && _wsRace) {
+            // the alternative won the race
+            std::swap(_ws, _wsRace);
+            std::swap(_wsId, _wsRaceId);
+            std::swap(_wsUri, _wsRaceUri);
+        } else if (id != _wsId) {
+            return; // stale socket
+        }
+        if (_wsRace) {
+            _wsRetired.push_back(std::move(_wsRace)); // can't destroy it from within a callback
+            _wsRaceId = 0;
+        }
+        _raceStartPending = false;
+        if (_racing) {
+            _racing = false;
+            set_preferred_scheme(get_uri_host(_wsUri), _wsUri.substr(0, _wsUri.find("://")));
+        }
+        _uri = _wsUri;
         debug("onopen()");
         log("Server connected");
         _state = State::SOCKET_CONNECTED;
         _pendingDataPackageRequests = 0;
+        _dataPackageRequestsInFlight = 0;
+        _dataPackageBatches.clear();
         _serverVersion = _generatorVersion = Version{0, 0, 0};
+        _lastReceive = now();
+        _wasConnected = true;
         if (_hOnSocketConnected) _hOnSocketConnected();
-        _socketReconnectInterval = 1500;
+        _reconnectBackoff = _reconnectPolicy.initialDelay;
+        _socketReconnectInterval = _reconnectBackoff;
+        // clients that lose the same server reconnect at the same time, so the first retry needs jitter too
+        jitter_reconnect_interval(std::max(_reconnectPolicy.maxDelay, _ws ? _ws->get_ok_connect_interval() : 0));
+    }
+
+    /// Label for per-command metrics of received commands. Unknown commands share one label, so a server can not
+    /// grow the metrics without bounds.
+    static const std::string& received_command_label(const std::string& cmd)
+    {
+        static const std::set<std::string> known = {
+            "RoomInfo", "ConnectionRefused", "Connected", "ReceivedItems", "LocationInfo", "RoomUpdate", "Print",
+            "PrintJSON", "DataPackage", "Bounced", "InvalidPacket", "Retrieved", "SetReply",
+        };
+        static const std::string other = "other";
+        const auto it = known.find(cmd);
+        return it != known.end() ? *it : other;
+    }
+
+    void send_packet(const json& packet)
+    {
+        if (!_pendingSets.empty())
+            flush_data_storage_writes(); // keep batched writes in front of later commands, e.g. so Get sees them
+        auto s = packet.dump();
+        _metrics.framesSent++;
+        _metrics.bytesSent += s.size();
+        for (const auto& command: packet)
+            _metrics.commandsSent[command.value("cmd", std::string())]++;
+        _ws->send(s);
     }
 
-    void onclose()
+    void onclose(unsigned id)
     {
+        if (id == _wsRaceId && _wsRace) {
+            lost_race(id); // the alternative failed, keep waiting for the primary
+            return;
+        }
+        if (id == _wsId && _raceStartPending)
+            start_race(); // the primary failed before its head start ran out
+        if (id != _wsId || lost_race(id))
+            return;
         debug("onclose()");
         if (_state > State::SOCKET_CONNECTING) {
             log("Server disconnected");
+            // a jittered reconnect interval counts from the disconnect, otherwise the first retry is immediate
+            if (_reconnectPolicy.jitter != ReconnectPolicy::Jitter::NONE)
+                _lastSocketConnect = now();
             _state = State::DISCONNECTED;
             if (_hOnSocketDisconnected) _hOnSocketDisconnected();
         }
         _state = State::DISCONNECTED;
         _seed = "";
+        _resuming = false;
+        fail_pending_requests(); // replies will never arrive
     }
 
-    void onmessage(const std::string& s)
+    void onmessage(unsigned id, const std::string& s)
+    {
+        if (id != _wsId)
+            return; // stale socket
+        _lastReceive = now();
+        _metrics.framesReceived++;
+        _metrics.bytesReceived += s.size();
+#ifndef AP_NO_THREADS
+        if (_asyncDataPackage && s.size() >= ASYNC_DATA_PACKAGE_MIN_SIZE && is_data_package_frame(s)
+                && start_data_package_job(s)) {
+            return;
+        }
+#endif
+        json packet;
+        try {
+            ScopedTimer timer(_metrics.parseTime);
+            packet = json::parse(s);
+        } catch (const std::exception& ex) {
+            log((std::string("onmessage() error: ") + ex.what()).c_str());
+            return;
+        }
+        process_packet(packet);
+    }
+
+    void process_packet(json& packet)
     {
         try {
-            json packet = json::parse(s);
 #ifndef AP_NO_SCHEMA
             valijson::Validator validator;
-            JsonSchemaAdapter packetAdapter(packet);
-            if (!validator.validate(_packetSchema, packetAdapter, nullptr)) {
-                throw std::runtime_error("Packet validation failed");
+            {
+                ScopedTimer timer(_metrics.validationTime);
+                JsonSchemaAdapter packetAdapter(packet);
+                if (!validator.validate(schemas().packet, packetAdapter, nullptr)) {
+                    throw std::runtime_error("Packet validation failed");
+                }
             }
 #endif
             for (auto& command: packet) {
                 std::string cmd = command["cmd"];
+                const auto& cmdLabel = received_command_label(cmd);
+                _metrics.commandsReceived[cmdLabel]++;
 #ifndef AP_NO_SCHEMA
-                JsonSchemaAdapter commandAdapter(command);
-                auto schemaIt = _commandSchemas.find(cmd);
-                if (schemaIt != _commandSchemas.end()) {
-                    if (!validator.validate(schemaIt->second, commandAdapter, nullptr)) {
-                        throw std::runtime_error("Command validation failed");
+                {
+                    ScopedTimer timer(_metrics.validationTime);
+                    JsonSchemaAdapter commandAdapter(command);
+                    const auto& commandSchemas = schemas().commands;
+                    auto schemaIt = commandSchemas.find(cmd);
+                    if (schemaIt != commandSchemas.end()) {
+                        if (!validator.validate(schemaIt->second, commandAdapter, nullptr)) {
+                            throw std::runtime_error("Command validation failed");
+                        }
                     }
                 }
 #endif
+                ScopedTimer timer(_metrics.handlerTime[cmdLabel]);
 #ifdef APCLIENT_DEBUG
                 const size_t maxDumpLen = 512;
                 auto dump = command.dump().substr(0, maxDumpLen);
@@ -1364,13 +2796,26 @@ private:
                 if (cmd == "RoomInfo") {
                     _localConnectTime = std::chrono::steady_clock::now();
                     _serverConnectTime = command["time"].get<double>();
+                    _rttSamples.clear(); // the route may have changed
                     _serverVersion = Version::from_json(command["version"]);
                     _generatorVersion = Version::from_json(command["generator_version"]);
                     _seed = command["seed_name"];
+                    if (_seed != _dataStorageCacheSeed) {
+                        // data storage is per room
+                        _dataStorageCache.clear();
+                        _dataStorageCacheSeed = _seed;
+                    }
                     _hintCostPercent = command.value("hint_cost", 0);
                     _hasPassword = command.value("password", false);
                     _commandPermissions = command.value("permissions", std::map<std::string, Permission>{});
                     if (_state < State::ROOM_INFO) _state = State::ROOM_INFO;
+                    if (_autoResume && _resumeValid && _state == State::ROOM_INFO && _resume.seed == _seed) {
+                        debug("Resuming slot " + _resume.name);
+                        ConnectSlot(_resume.name, _resume.password, _resume.itemsHandling, _resume.tags,
+                                    _resume.version);
+                        _resumeValid = true; // ConnectSlot reset it
+                        _resuming = true;
+                    }
                     if (_hOnRoomInfo) _hOnRoomInfo();
 
                     // check if cached data package is already valid
@@ -1408,7 +2853,11 @@ private:
                         }
                     }
 
+                    _lazyGames.clear();
+                    _lazyLoadQueue.clear();
+                    std::vector<CachedGame> cached;
                     for (const auto& game: playedGames) {
+                        const auto gameId = intern_game(game);
                         std::string remoteChecksum;
                         int remoteVersion = 0;
                         if (itChecksums != command.end()) {
@@ -1416,13 +2865,38 @@ private:
                             if (itChecksum != itChecksums->end() && itChecksum->is_string())
                                 remoteChecksum = *itChecksum;
                         }
-                        if (itVersions != command.end()) {
+                        if (_lazyDataPackage && !remoteChecksum.empty() && game != _game) {
+                            // load on first lookup, the own game is needed right away for lookups by name
+                            auto itOld = _dataPackage["games"].find(game);
+                            if (itOld == _dataPackage["games"].end() || itOld->value("checksum", "") != remoteChecksum) {
+                                // only checks if the store has it, so the first lookup knows where to get it from
+                                const bool inStore = data_package_cached(game, remoteChecksum);
+                                if (!inStore)
+                                    debug("Data package for " + game + " not cached");
+                                _lazyGames[gameId] = {remoteChecksum, false, inStore};
+                            }
+                            exclude.push_back(game);
+                            continue;
+                        }
+                        if (itVersions != command.end()) {
                             auto itVersion = itVersions->find(game);
                             if (itVersion != itVersions->end() && itVersion->is_number_integer())
                                 remoteVersion = *itVersion;
                         }
-                        json localData;
-                        if (!_dataPackageStore || !_dataPackageStore->load(game, remoteChecksum, localData)) {
+                        cached.push_back({game, remoteChecksum, remoteVersion, false, json()});
+                    }
+
+                    // read the cache in parallel, decide in order
+                    run_parallel(cached.size(), [this, &cached](size_t i) {
+                        auto& entry = cached[i];
+                        entry.loaded = load_data_package(entry.game, entry.checksum, entry.data);
+                    });
+                    for (auto& entry: cached) {
+                        const auto& game = entry.game;
+                        const auto& remoteChecksum = entry.checksum;
+                        const int remoteVersion = entry.version;
+                        json& localData = entry.data;
+                        if (!entry.loaded) {
                             if (remoteChecksum.empty() && remoteVersion != 0) {
                                 auto itOld = _dataPackage["games"].find(game);
                                 if (itOld != _dataPackage["games"].end()) {
@@ -1441,7 +2915,7 @@ private:
                             // compare checksum
                             auto it = localData.find("checksum");
                             if (it != localData.end() && it->is_string() && *it == remoteChecksum) {
-                                _dataPackage["games"][game] = localData;
+                                _dataPackage["games"][game] = std::move(localData);
                                 exclude.push_back(game);
                             } else {
                                 include.push_back(game);
@@ -1450,7 +2924,7 @@ private:
                         } else {
                             const auto it = localData.find("version");
                             if (remoteVersion != 0 && it != localData.end() && it->is_number_integer() && *it == remoteVersion) {
-                                _dataPackage["games"][game] = localData;
+                                _dataPackage["games"][game] = std::move(localData);
                                 exclude.push_back(game);
                             } else {
                                 include.push_back(game);
@@ -1460,7 +2934,7 @@ private:
                     }
 
                     if (!exclude.empty())
-                        _set_data_package(_dataPackage);  // apply loaded strings
+                        apply_data_package(exclude);  // apply loaded strings
                     if (!_dataPackageValid) GetDataPackage(include);
                     else debug("Data package up to date");
                 }
@@ -1471,6 +2945,9 @@ private:
                             errors.push_back(error);
                         _hOnSlotRefused(errors);
                     }
+                    _resuming = false;
+                    _resumeValid = false;
+                    complete_connect(false, command);
                 }
                 else if (cmd == "Connected") {
                     // store data
@@ -1480,6 +2957,7 @@ private:
                     _hintPoints = command.value("hint_points", static_cast<int>(command["checked_locations"].size()));
                     _locationCount = static_cast<int>(command["missing_locations"].size() + command["checked_locations"].size());
                     _players.clear();
+                    _renderGeneration++;
                     for (auto& player: command["players"]) {
                         _players.push_back({
                             player["team"].get<int>(),
@@ -1505,12 +2983,23 @@ private:
                             const auto& j = it.value();
                             j.at("name").get_to(slot.name);
                             j.at("game").get_to(slot.game);
+                            slot.gameId = intern_game(slot.game);
                             j.at("type").get_to(slot.type);
                             j.at("group_members").get_to(slot.members);
                             int player = atoi(it.key().c_str());
                             _slotInfo[player] = slot;
                         }
                     }
+                    update_slot_names();
+                    // SetNotify is per connection, subscribe again and catch up.
+                    // This has to happen before the callbacks, so subscriptions made from them are not sent twice.
+                    _notifiedKeys.clear();
+                    if (!_dataStorageSubscriptions.empty()) {
+                        std::list<std::string> keys;
+                        for (const auto& pair: _dataStorageSubscriptions)
+                            keys.push_back(pair.first);
+                        send_data_storage_subscriptions(keys);
+                    }
                     // run the callbacks
                     if (_hOnSlotConnected)
                         _hOnSlotConnected(command["slot_data"]);
@@ -1553,6 +3042,20 @@ private:
                         }
                         _createHintsQueueByPlayerAndStatus.clear();
                     }
+                    // send status that was set while disconnected
+                    if (_resuming && _clientStatus != ClientStatus::UNKNOWN) {
+                        auto status = _clientStatus;
+                        _clientStatus = ClientStatus::UNKNOWN;
+                        StatusUpdate(status);
+                    }
+                    _resuming = false;
+                    _resumeValid = true;
+                    if (_connectStartValid) {
+                        _connectStartValid = false;
+                        _metrics.timeToConnected.observe(std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - _connectStart).count());
+                    }
+                    complete_connect(true, command);
                 }
                 else if (cmd == "ReceivedItems") {
                     std::list<NetworkItem> items;
@@ -1579,6 +3082,28 @@ private:
                         item.index = -1;
                         items.push_back(item);
                     }
+                    // the reply is for the oldest pending scout that requested all of its locations
+                    auto it = std::find_if(_pendingScouts.begin(), _pendingScouts.end(),
+                                           [&items](const PendingScout& pending) {
+                        return std::all_of(items.begin(), items.end(), [&pending](const NetworkItem& item) {
+                            return pending.locations.count(item.location) > 0;
+                        });
+                    });
+                    if (it != _pendingScouts.end()) {
+                        // earlier scouts did not get a reply and will not get one anymore
+                        std::list<PendingScout> skipped;
+                        skipped.splice(skipped.end(), _pendingScouts, _pendingScouts.begin(), it);
+                        auto pending = std::move(_pendingScouts.front());
+                        _pendingScouts.pop_front();
+                        for (auto& skippedScout: skipped) {
+                            if (skippedScout.cb)
+                                skippedScout.cb(false, {});
+                        }
+                        if (pending.cb) {
+                            pending.cb(true, items);
+                            continue;
+                        }
+                    }
                     if (_hOnLocationInfo) _hOnLocationInfo(items);
                 }
                 else if (cmd == "RoomUpdate") {
@@ -1596,6 +3121,7 @@ private:
                         _hintPoints = command["hint_points"];
                     if (command["players"].is_array()) {
                         _players.clear();
+                        _renderGeneration++;
                         for (auto& player: command["players"]) {
                             _players.push_back({
                                 player["team"].get<int>(),
@@ -1604,6 +3130,7 @@ private:
                                 player["name"].get<std::string>(),
                             });
                         }
+                        update_slot_names();
                     }
 
                     auto itPermissions = command.find("permissions");
@@ -1617,17 +3144,36 @@ private:
                         _hOnRoomUpdate();
                 }
                 else if (cmd == "DataPackage") {
-                    auto data = _dataPackage;
-                    if (!data["games"].is_object())
-                        data["games"] = json(json::value_t::object);
-                    for (const auto& gamePair: command["data"]["games"].items()) {
-                        if (_dataPackageStore)
-                            _dataPackageStore->save(gamePair.key(), gamePair.value());
-                        data["games"][gamePair.key()] = gamePair.value();
+                    auto& games = _dataPackage["games"];
+                    if (!games.is_object())
+                        games = json(json::value_t::object);
+                    std::list<std::string> received;
+                    for (auto& gamePair: command["data"]["games"].items()) {
+                        const auto& game = gamePair.key();
+                        const auto gameId = intern_game(game);
+                        auto parsedIt = _parsedGames.find(game);
+                        if (parsedIt != _parsedGames.end()) {
+                            // indexed and saved by start_data_package_job
+                            add_game_names(gameId, std::move(parsedIt->second));
+                            _parsedGames.erase(parsedIt);
+                        } else {
+                            save_data_package(game, gamePair.value());
+                            add_game_names(gameId, gamePair.value());
+                        }
+                        games[game] = std::move(gamePair.value());
+                        received.push_back(game);
                     }
-                    data["version"] = command["data"].value<int>("version", -1); // -1 for backwards compatibility
+                    _dataPackage["version"] = command["data"].value<int>("version", -1); // -1 for backwards compatibility
                     _dataPackageValid = false;
-                    _set_data_package(data);
+                    _renderGeneration++;
+                    update_slot_names();
+                    for (const auto& game: received) {
+                        if (_lazyGames.erase(get_game_id(game)) && _hOnGameNamesLoaded)
+                            _hOnGameNamesLoaded(game);
+                    }
+                    if (_dataPackageRequestsInFlight > 0)
+                        _dataPackageRequestsInFlight--;
+                    send_data_package_batches();
                     if (_pendingDataPackageRequests > 0) {
                         _pendingDataPackageRequests--;
                         if (_pendingDataPackageRequests == 0) {
@@ -1637,28 +3183,63 @@ private:
                     }
                 }
                 else if (cmd == "Print") {
+                    if (_historyBudget)
+                        add_history_entry(command, true);
                     if (_hOnPrint) _hOnPrint(command["text"].get<std::string>());
                 }
                 else if (cmd == "PrintJSON") {
-                    if (_hOnPrintJson) _hOnPrintJson(command);
+                    if (_historyBudget)
+                        add_history_entry(command, false); // before handlers may move strings out
+                    if (_hOnPrintJsonMutable) _hOnPrintJsonMutable(command);
+                    else if (_hOnPrintJson) _hOnPrintJson(command);
                 }
                 else if (cmd == "Bounced") {
                     if (_hOnBounced) _hOnBounced(command);
                 }
                 else if (cmd == "Retrieved") {
-                    if (_hOnRetrieved) {
-                        std::map<std::string, json> keys;
-                        for (auto& pair: command["keys"].items())
-                            keys[pair.key()] = pair.value();
-                        _hOnRetrieved(keys, command);
+                    // replies to our own probes are not of interest to the cache or user
+                    const bool internal = command.value(request_internal_key(), false);
+                    if (_dataStorageCacheEnabled && !internal) {
+                        for (const auto& pair: command["keys"].items())
+                            update_data_storage_cache(pair.key(), pair.value());
+                    }
+                    auto& keys = command["keys"];
+                    if (complete_request(command, keys) || internal)
+                        continue;
+                    if (_hOnRetrievedJson) {
+                        _hOnRetrievedJson(keys, command);
+                    } else if (_hOnRetrievedKeys) {
+                        // nothing else will look at the packet, so we can move the values out of it
+                        std::map<std::string, json> map;
+                        for (auto it = keys.begin(); it != keys.end(); ++it)
+                            map.emplace_hint(map.end(), it.key(), std::move(it.value()));
+                        _hOnRetrievedKeys(map);
+                    } else if (_hOnRetrieved) {
+                        std::map<std::string, json> map;
+                        for (auto it = keys.begin(); it != keys.end(); ++it)
+                            map.emplace_hint(map.end(), it.key(), it.value());
+                        _hOnRetrieved(map, command);
                     }
                 }
                 else if (cmd == "SetReply") {
+                    if (_dataStorageCacheEnabled)
+                        update_data_storage_cache(command["key"].get<std::string>(), command["value"]);
+                    complete_request(command, command); // also forwarded below, since it may be a notification
                     if (_hOnSetReply) {
                         command["original_value"]; // insert null if missing
                         _hOnSetReply(command);
                     }
                 }
+                else if (cmd == "InvalidPacket") {
+                    log("Invalid packet: " + command.value("text", std::string()));
+                    if (command.value("original_cmd", std::string()) == "LocationScouts" && !_pendingScouts.empty()) {
+                        // there will be no LocationInfo for the rejected scout
+                        auto pending = std::move(_pendingScouts.front());
+                        _pendingScouts.pop_front();
+                        if (pending.cb)
+                            pending.cb(false, {});
+                    }
+                }
                 else {
                     debug("unhandled cmd");
                 }
@@ -1668,107 +3249,1225 @@ private:
         }
     }
 
-    void onerror(const std::string& msg = "")
+    void onerror(unsigned id, const std::string& msg = "")
     {
+        if (id == _wsRaceId && _wsRace) {
+            lost_race(id); // the alternative failed, keep waiting for the primary
+            return;
+        }
+        if (id == _wsId && _raceStartPending)
+            start_race(); // the primary failed before its head start ran out
+        if (id != _wsId || lost_race(id))
+            return;
         debug("onerror(" + msg + ")");
         if (_hOnSocketError) _hOnSocketError(msg);
-        // TODO: on desktop, we could check if the error was handle_read_http_response before switching to wss://
-        //       and handle_transport_init before switching to ws://
-        if (_tryWSS && _uri.rfind("ws://", 0) == 0) {
-            _uri = "wss://" + _uri.substr(5);
-            if (_state == State::SOCKET_CONNECTING)
-                _reconnectNow = true; // force immediate connect attempt
-        } else if (_tryWSS && _uri.rfind("wss://", 0) == 0) {
-            _uri = "ws://" + _uri.substr(6);
+        if (_tryWSS && !_racing && _state == State::SOCKET_CONNECTING) {
+            // the remembered scheme did not work (anymore), race both schemes right away
+            set_preferred_scheme(get_uri_host(_uri), "");
+            _reconnectNow = true;
         }
     }
 
-    void connect_socket()
+    /// Start connecting with the alternative scheme of a ws/wss race
+    void start_race()
     {
-        _reconnectNow = false;
-        _ws.reset();
-        if (_uri.empty()) {
-            _ws = nullptr;
-            _state = State::DISCONNECTED;
-            return;
+        _raceStartPending = false;
+        _wsRaceId = ++_lastWsId;
+        _wsRace = create_ws(_wsRaceUri, _wsRaceId);
+    }
+
+    /// Drop a failed socket if the other one of a ws/wss race is still connecting. Returns true if it was dropped.
+    bool lost_race(unsigned id)
+    {
+        if (!_wsRace)
+            return false;
+        debug("Connection to " + (id == _wsId ? _wsUri : _wsRaceUri) + " failed");
+        if (id == _wsId) {
+            std::swap(_ws, _wsRace);
+            _wsId = _wsRaceId;
+            _wsUri = _wsRaceUri;
         }
-        _state = State::SOCKET_CONNECTING;
+        _wsRetired.push_back(std::move(_wsRace)); // can't destroy it from within a callback
+        _wsRaceId = 0;
+        return true;
+    }
 
+    std::unique_ptr<WS> create_ws(const std::string& uri, unsigned id)
+    {
         try {
-            _ws = std::make_unique<WS>(_uri,
-                    [this]() { onopen(); },
-                    [this]() { onclose(); },
-                    [this](const std::string& s) { onmessage(s); },
+            return std::make_unique<WS>(uri,
+                    [this, id]() { onopen(id); },
+                    [this, id]() { onclose(id); },
+                    [this, id](const std::string& s) { onmessage(id, s); },
 #if WSWRAP_VERSION >= 10200
-                    [this](const std::string& s) { onerror(s); }
+                    [this, id](const std::string& s) { onerror(id, s); }
 #else
-                    [this]() { onerror(); }
+                    [this, id]() { onerror(id); }
 #endif
 #if WSWRAP_VERSION >= 10100
                     , _certStore
 #endif
             );
         } catch (const std::exception& ex) {
+            log((std::string("error connecting: ") + ex.what()).c_str());
+            return nullptr;
+        }
+    }
+
+    void connect_socket()
+    {
+        _reconnectNow = false;
+        _ws.reset();
+        _wsRace.reset();
+        _wsId = _wsRaceId = 0;
+        _racing = false;
+        _raceStartPending = false;
+        if (_uri.empty()) {
             _ws = nullptr;
-            if (_tryWSS && _uri.rfind("ws://", 0) == 0) {
-                _uri = "wss://" + _uri.substr(5);
-            } else {
-                _uri = "ws://" + _uri.substr(6);
+            _state = State::DISCONNECTED;
+            return;
+        }
+        _state = State::SOCKET_CONNECTING;
+        _metrics.connectAttempts++;
+        if (_wasConnected) {
+            _wasConnected = false;
+            _metrics.reconnects++;
+        }
+        if (!_connectStartValid) {
+            _connectStartValid = true;
+            _connectStart = std::chrono::steady_clock::now();
+        }
+
+        // without a scheme given, race ws:// and wss:// unless we know which one works for the host
+        const auto host = get_uri_host(_uri);
+        const auto preferredScheme = _tryWSS ? get_preferred_scheme(host) : "";
+        if (!preferredScheme.empty())
+            _uri = preferredScheme + "://" + host + _uri.substr(_uri.find("://") + 3 + host.length());
+        _wsUri = _uri;
+        _wsId = ++_lastWsId;
+        _ws = create_ws(_wsUri, _wsId);
+        if (_tryWSS && preferredScheme.empty()) {
+            // the plain connection would almost always win, so the preferred scheme gets a head start
+            _racing = true;
+            _wsRaceUri = (_uri.rfind("wss://", 0) == 0) ? "ws://" + _uri.substr(6) : "wss://" + _uri.substr(5);
+            _raceStartPending = true;
+            if (!_ws) {
+                start_race();
+                std::swap(_ws, _wsRace);
+                std::swap(_wsId, _wsRaceId);
+                std::swap(_wsUri, _wsRaceUri);
             }
-            log((std::string("error connecting: ") + ex.what()).c_str());
+        } else if (!_ws && _tryWSS) {
+            set_preferred_scheme(host, ""); // race next time
         }
         _lastSocketConnect = now();
-        _socketReconnectInterval *= 2;
         // NOTE: browsers have a very badly implemented connection rate limit
         // alternatively we could always wait for onclose() to get the actual
         // allowed rate once we are over it
-        const unsigned long maxReconnectInterval = std::max(15000UL, _ws ? _ws->get_ok_connect_interval() : 0);
+        const unsigned long maxReconnectInterval = std::max(_reconnectPolicy.maxDelay,
+                                                            _ws ? _ws->get_ok_connect_interval() : 0);
+        const double backoff = static_cast<double>(_reconnectBackoff) * _reconnectPolicy.multiplier;
+        _reconnectBackoff = backoff > maxReconnectInterval ? maxReconnectInterval
+                                                           : static_cast<unsigned long>(backoff);
+        jitter_reconnect_interval(maxReconnectInterval);
+    }
+
+    /// Set _socketReconnectInterval from _reconnectBackoff according to the jitter of the reconnect policy
+    void jitter_reconnect_interval(unsigned long maxReconnectInterval)
+    {
+        switch (_reconnectPolicy.jitter) {
+            case ReconnectPolicy::Jitter::NONE:
+                _socketReconnectInterval = _reconnectBackoff;
+                break;
+            case ReconnectPolicy::Jitter::FULL:
+                _socketReconnectInterval = std::uniform_int_distribution<unsigned long>(0, _reconnectBackoff)(_rng);
+                break;
+            case ReconnectPolicy::Jitter::DECORRELATED: {
+                const unsigned long lo = _reconnectPolicy.initialDelay;
+                const unsigned long hi = std::max(lo, std::min(maxReconnectInterval, _socketReconnectInterval * 3));
+                _socketReconnectInterval = std::uniform_int_distribution<unsigned long>(lo, hi)(_rng);
+                break;
+            }
+        }
         if (_socketReconnectInterval > maxReconnectInterval)
             _socketReconnectInterval = maxReconnectInterval;
     }
 
-    void _set_data_package(const json& data)
+    /// Build the name tables of the given games from _dataPackage. Tables are built in parallel and merged in order,
+    /// so the result is the same for any number of threads.
+    void apply_data_package(const std::list<std::string>& gameNames)
+    {
+        _renderGeneration++;
+        const auto& packageGames = _dataPackage["games"];
+        std::vector<std::pair<GameId, const json*>> games;
+        for (const auto& game: gameNames) {
+            const auto it = packageGames.find(game);
+            if (it != packageGames.end())
+                games.emplace_back(intern_game(game), &*it);
+        }
+        std::vector<GameNames> names(games.size());
+        run_parallel(games.size(), [&games, &names](size_t i) {
+            names[i] = build_game_names(*games[i].second);
+        });
+        for (size_t i = 0; i < games.size(); i++)
+            add_game_names(games[i].first, std::move(names[i]));
+        update_slot_names();
+    }
+
+    /// Id to name table of a single game, sorted by id. Built once, so lookups are a binary search in one block.
+    struct NameTable {
+        std::vector<std::pair<int64_t, std::string>> entries;
+
+        /// Get the name of id or nullptr
+        const std::string* find(int64_t id) const
+        {
+            const auto it = std::lower_bound(entries.begin(), entries.end(), id,
+                                             [](const std::pair<int64_t, std::string>& entry, int64_t id) {
+                                                 return entry.first < id;
+                                             });
+            return it != entries.end() && it->first == id ? &it->second : nullptr;
+        }
+    };
+
+    /// Id to name tables of a single game
+    struct GameNames {
+        NameTable items;
+        NameTable locations;
+        size_t size = 0; ///< approximate size in the data package
+    };
+
+    /// Build the tables of a game. Does not touch the instance, so this can run on any thread.
+    static GameNames build_game_names(const json& gameData)
+    {
+        constexpr size_t entryOverhead = 24; // quotes, colon, comma and id in json
+        GameNames names;
+        auto build = [&names](const json& gameData, const char* key, NameTable& table) {
+            auto it = gameData.find(key);
+            if (it == gameData.end())
+                return;
+            auto& entries = table.entries;
+            entries.reserve(it->size());
+            for (const auto& pair: it->items()) {
+                entries.emplace_back(pair.value().get<int64_t>(), pair.key());
+                names.size += pair.key().size() + entryOverhead;
+            }
+            std::sort(entries.begin(), entries.end());
+            // if names share an id, keep the last one like assigning them to a map in order would
+            size_t count = 0;
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (count > 0 && entries[count - 1].first == entries[i].first) {
+                    entries[count - 1] = std::move(entries[i]);
+                } else {
+                    if (count != i)
+                        entries[count] = std::move(entries[i]);
+                    count++;
+                }
+            }
+            entries.resize(count);
+        };
+        build(gameData, "item_name_to_id", names.items);
+        build(gameData, "location_name_to_id", names.locations);
+        return names;
+    }
+
+    void add_game_names(GameId gameId, const json& gameData)
+    {
+        add_game_names(gameId, build_game_names(gameData));
+    }
+
+    void add_game_names(GameId gameId, GameNames&& names)
+    {
+        for (const auto& pair: names.items.entries)
+            _items[pair.first] = pair.second;
+        for (const auto& pair: names.locations.entries)
+            _locations[pair.first] = pair.second;
+        _gameItems[gameId] = std::move(names.items);
+        _gameLocations[gameId] = std::move(names.locations);
+        set_data_package_size(_gameNames[gameId], names.size);
+    }
+
+    /// Calls to the data package store are serialized unless it is thread-safe, since data packages may be
+    /// loaded and saved from worker threads
+    std::unique_lock<std::mutex> lock_data_package_store()
+    {
+        if (_dataPackageStore && _dataPackageStore->is_thread_safe())
+            return {};
+        return std::unique_lock<std::mutex>(_dataPackageStoreMutex);
+    }
+
+    bool load_data_package(const std::string& game, const std::string& checksum, json& data)
+    {
+        auto lock = lock_data_package_store();
+        return _dataPackageStore && _dataPackageStore->load(game, checksum, data);
+    }
+
+    bool data_package_cached(const std::string& game, const std::string& checksum)
+    {
+        auto lock = lock_data_package_store();
+        return _dataPackageStore && _dataPackageStore->contains(game, checksum);
+    }
+
+    bool save_data_package(const std::string& game, const json& data)
+    {
+        auto lock = lock_data_package_store();
+        return _dataPackageStore && _dataPackageStore->save(game, data);
+    }
+
+    /// Cached data package of a played game, \sa see RoomInfo
+    struct CachedGame {
+        std::string game;
+        std::string checksum;
+        int version;
+        bool loaded;
+        json data;
+    };
+
+#ifndef AP_NO_THREADS
+    /// Threads for run_parallel. They are started on first use and kept until the instance is destroyed.
+    struct LoadPool {
+        std::mutex mutex;
+        std::condition_variable cv; ///< signals new work or stop to the threads
+        std::condition_variable doneCv; ///< signals finished work to run_parallel
+        std::function<void()> work; ///< current batch
+        uint64_t generation = 0; ///< incremented for every batch
+        size_t slots = 0; ///< number of threads that may still join the current batch
+        size_t running = 0; ///< number of threads working on the current batch
+        bool stop = false;
+        std::vector<std::thread> threads;
+
+        ~LoadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            cv.notify_all();
+            for (auto& thread: threads)
+                thread.join();
+        }
+
+        /// Start threads until there are at least count, returns the actual number
+        size_t reserve(size_t count)
+        {
+            try {
+                while (threads.size() < count)
+                    threads.emplace_back(&LoadPool::run, this);
+            } catch (const std::system_error&) {
+                // continue with the threads that could be started
+            }
+            return threads.size();
+        }
+
+        void run()
+        {
+            uint64_t seen = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cv.wait(lock, [this, seen] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+                if (slots == 0)
+                    continue; // batch is full or over
+                slots--;
+                running++;
+                lock.unlock();
+                work();
+                lock.lock();
+                running--;
+                doneCv.notify_all();
+            }
+        }
+    };
+#endif
+
+    /// Run job(0) to job(count - 1) on up to _dataPackageLoadThreads threads and wait for them to finish.
+    /// If jobs throw, the exception of the first failed job is rethrown.
+    template <class F>
+    void run_parallel(size_t count, F&& job)
+    {
+#ifndef AP_NO_THREADS
+        size_t threads = _dataPackageLoadThreads ? _dataPackageLoadThreads : std::thread::hardware_concurrency();
+        threads = std::min(threads, count);
+        if (threads > 1) {
+            if (!_loadPool)
+                _loadPool.reset(new LoadPool());
+            auto& pool = *_loadPool;
+            const size_t helpers = std::min(threads - 1, pool.reserve(threads - 1));
+            std::atomic<size_t> next{0};
+            std::vector<std::exception_ptr> errors(count);
+            auto work = [&]() {
+                for (size_t i = next++; i < count; i = next++) {
+                    try {
+                        job(i);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                }
+            };
+            {
+                std::lock_guard<std::mutex> lock(pool.mutex);
+                pool.work = work;
+                pool.generation++;
+                pool.slots = helpers;
+            }
+            pool.cv.notify_all();
+            work();
+            {
+                // threads that did not pick up the batch yet would find nothing left to do
+                std::unique_lock<std::mutex> lock(pool.mutex);
+                pool.slots = 0;
+                pool.doneCv.wait(lock, [&pool] { return pool.running == 0; });
+                pool.work = nullptr;
+            }
+            for (const auto& error: errors) {
+                if (error)
+                    std::rethrow_exception(error);
+            }
+            return;
+        }
+#endif
+        for (size_t i = 0; i < count; i++)
+            job(i);
+    }
+
+#ifndef AP_NO_THREADS
+    /// DataPackage frame that was parsed and indexed by a worker thread
+    struct ParsedDataPackage {
+        unsigned socket = 0;
+        double parseTime = 0;
+        json packet;
+        std::map<std::string, GameNames> games;
+    };
+
+    /// Quick check if the frame starts with a DataPackage command, i.e. `[{"cmd":"DataPackage"`.
+    /// The server sends DataPackage in a frame of its own.
+    static bool is_data_package_frame(const std::string& s)
+    {
+        static const char* const tokens[] = {"[", "{", "\"cmd\"", ":", "\"DataPackage\""};
+        size_t pos = 0;
+        for (const char* token: tokens) {
+            pos = s.find_first_not_of(" \t\r\n", pos);
+            const size_t len = strlen(token);
+            if (pos == std::string::npos || s.compare(pos, len, token) != 0)
+                return false;
+            pos += len;
+        }
+        return true;
+    }
+
+    /// Parse, index and save a DataPackage frame on a worker thread, \sa see publish_data_packages.
+    /// Returns false if no thread could be started, in which case the frame has to be processed right away.
+    bool start_data_package_job(const std::string& s)
+    {
+        const unsigned socket = _wsId;
+        std::future<ParsedDataPackage> job;
+        try {
+            job = std::async(std::launch::async, [this, socket, s]() {
+                ParsedDataPackage res;
+                res.socket = socket;
+                const auto start = std::chrono::steady_clock::now();
+                res.packet = json::parse(s);
+                res.parseTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                for (const auto& command: res.packet) {
+                    if (!command.is_object() || command.value("cmd", "") != "DataPackage")
+                        continue;
+                    const auto itData = command.find("data");
+                    if (itData == command.end() || !itData->is_object())
+                        continue;
+                    const auto itGames = itData->find("games");
+                    if (itGames == itData->end() || !itGames->is_object())
+                        continue;
+                    for (const auto& gamePair: itGames->items()) {
+                        save_data_package(gamePair.key(), gamePair.value());
+                        res.games[gamePair.key()] = build_game_names(gamePair.value());
+                    }
+                }
+                return res;
+            });
+        } catch (const std::system_error& ex) {
+            log((std::string("could not start data package thread: ") + ex.what()).c_str());
+            return false;
+        }
+        _dataPackageJobs.push_back(std::move(job));
+        return true;
+    }
+
+    /// Process DataPackage frames that finished parsing, in the order they were received
+    void publish_data_packages()
+    {
+        while (!_dataPackageJobs.empty() &&
+                _dataPackageJobs.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            auto job = std::move(_dataPackageJobs.front());
+            _dataPackageJobs.pop_front();
+            ParsedDataPackage parsed;
+            try {
+                parsed = job.get();
+            } catch (const std::exception& ex) {
+                log((std::string("onmessage() error: ") + ex.what()).c_str());
+                continue;
+            }
+            if (parsed.socket != _wsId)
+                continue; // stale socket
+            _metrics.parseTime.observe(parsed.parseTime);
+            _parsedGames = std::move(parsed.games);
+            process_packet(parsed.packet);
+            _parsedGames.clear();
+        }
+    }
+#endif
+
+    void send_data_package_batches()
+    {
+        while (!_dataPackageBatches.empty() && _dataPackageRequestsInFlight < _dataPackageMaxInFlight) {
+            auto packet = json{{
+                {"cmd", "GetDataPackage"},
+                {"games", std::move(_dataPackageBatches.front())}, // since 0.3.2
+            }};
+            _dataPackageBatches.pop_front();
+            debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
+            send_packet(packet);
+            _dataPackageRequestsInFlight++;
+            _pendingDataPackageRequests++;
+        }
+    }
+
+    size_t get_data_package_size_estimate(const std::string& game)
+    {
+        constexpr size_t defaultSize = 64 * 1024; // a typical game
+        {
+            std::unique_lock<std::mutex> lock;
+            const auto& sizes = data_package_sizes(lock);
+            const auto it = sizes.find(game);
+            if (it != sizes.end())
+                return it->second;
+        }
+        size_t size = 0;
+        {
+            auto lock = lock_data_package_store();
+            if (_dataPackageStore)
+                size = _dataPackageStore->get_size_hint(game);
+        }
+        return size ? size : defaultSize;
+    }
+
+    static void set_data_package_size(const std::string& game, size_t size)
+    {
+        std::unique_lock<std::mutex> lock;
+        data_package_sizes(lock)[game] = size;
+    }
+
+    /// Approximate data package size by game, shared between all instances
+    static std::map<std::string, size_t>& data_package_sizes(std::unique_lock<std::mutex>& lock)
     {
-        _dataPackage = data;
-        for (const auto& gamePair: _dataPackage["games"].items()) {
-            const auto& gameData = gamePair.value();
-            _dataPackage["games"][gamePair.key()] = gameData;
-            auto& gameItems = _gameItems[gamePair.key()];
-            for (const auto& pair: gameData["item_name_to_id"].items()) {
-                auto id = pair.value().get<int64_t>();
-                _items[id] = pair.key();
-                gameItems[id] = pair.key();
+        static std::mutex mutex;
+        static std::map<std::string, size_t> sizes;
+        lock = std::unique_lock<std::mutex>(mutex);
+        return sizes;
+    }
+
+    /// Queue loading a lazy game, \sa see set_lazy_data_package
+    void request_lazy_game(GameId game) const
+    {
+        if (_lazyGames.empty())
+            return;
+        auto it = _lazyGames.find(game);
+        if (it != _lazyGames.end() && !it->second.queued) {
+            it->second.queued = true;
+            _lazyLoadQueue.push_back(game);
+        }
+    }
+
+    /// Queue loading all lazy games if enabled. Used for lookups by global id, which can be from any game.
+    void request_lazy_games() const
+    {
+        if (!_lazyLoadAllForGlobalIds)
+            return;
+        for (auto& pair: _lazyGames) {
+            if (!pair.second.queued) {
+                pair.second.queued = true;
+                _lazyLoadQueue.push_back(pair.first);
             }
-            auto& gameLocations = _gameLocations[gamePair.key()];
-            for (const auto& pair: gameData["location_name_to_id"].items()) {
-                auto id = pair.value().get<int64_t>();
-                _locations[id] = pair.key();
-                gameLocations[id] = pair.key();
+        }
+    }
+
+    /// Load queued lazy games from the store or request them from the server
+    void load_lazy_games()
+    {
+        auto queue = std::move(_lazyLoadQueue);
+        _lazyLoadQueue.clear();
+        std::list<std::string> include;
+        std::list<std::string> loaded;
+        for (GameId gameId: queue) {
+            auto it = _lazyGames.find(gameId);
+            if (it == _lazyGames.end())
+                continue;
+            const auto& game = _gameNames[gameId];
+            json data;
+            if (it->second.cached && load_data_package(game, it->second.checksum, data)
+                    && data.value("checksum", "") == it->second.checksum) {
+                add_game_names(gameId, data);
+                _dataPackage["games"][game] = std::move(data);
+                _lazyGames.erase(it);
+                loaded.push_back(game);
+            } else {
+                include.push_back(game); // stays in _lazyGames until DataPackage arrives
+            }
+        }
+        if (!loaded.empty()) {
+            _renderGeneration++;
+            if (_hOnGameNamesLoaded) {
+                for (const auto& game: loaded)
+                    _hOnGameNamesLoaded(game);
             }
         }
+        if (!include.empty())
+            GetDataPackage(include);
+    }
+
+    struct SlotNames {
+        GameId game = INVALID_GAME_ID; ///< invalid if slot info is unknown, then global ids are used
+        const std::string* alias = nullptr;
+    };
+
+    struct RenderedHistoryEntry {
+        std::string text;
+        uint64_t generation = 0;
+        bool valid = false;
+    };
+
+    struct StoredHistoryEntry {
+        HistoryEntry entry;
+        std::set<int> players;
+        std::set<int64_t> items;
+        size_t size = 0; ///< estimated memory without rendered
+        RenderedHistoryEntry rendered[3]; ///< by RenderFormat
+    };
+
+    GameId intern_game(const std::string& game)
+    {
+        const auto res = _gameIds.emplace(game, static_cast<GameId>(_gameNames.size()));
+        if (res.second) {
+            _gameNames.push_back(game);
+            _gameItems.resize(_gameNames.size());
+            _gameLocations.resize(_gameNames.size());
+        }
+        return res.first->second;
     }
 
-    static std::string color2ansi(const std::string& color)
+    /// Store each slot's game and alias in a table, so render_json does one lookup per node
+    void update_slot_names()
     {
-        // convert color to ansi color command
-        if (color == "red") return "\x1b[31m";
-        if (color == "green") return "\x1b[32m";
-        if (color == "yellow") return "\x1b[33m";
-        if (color == "blue") return "\x1b[34m";
-        if (color == "magenta") return "\x1b[35m";
-        if (color == "cyan") return "\x1b[36m";
-        if (color == "plum") return "\x1b[38:5:219m";
-        if (color == "slateblue") return "\x1b[38:5:62m";
-        if (color == "salmon") return "\x1b[38:5:210m";
-        if (color == "gray") return "\x1b[90m";
-        if (color == "grey") return "\x1b[90m";
-        return "\x1b[0m";
+        constexpr int maxSlot = 0xffff; // slots are numbered consecutively, this can't be reached
+        _slotNames.clear();
+        for (const auto& pair: _slotInfo) {
+            if (pair.first <= 0 || pair.first > maxSlot || pair.second.gameId == INVALID_GAME_ID)
+                continue;
+            if (_slotNames.size() <= static_cast<size_t>(pair.first))
+                _slotNames.resize(static_cast<size_t>(pair.first) + 1);
+            _slotNames[static_cast<size_t>(pair.first)].game = pair.second.gameId;
+        }
+        for (const auto& player: _players) {
+            if (player.team != _team || player.slot <= 0 || player.slot > maxSlot)
+                continue;
+            if (_slotNames.size() <= static_cast<size_t>(player.slot))
+                _slotNames.resize(static_cast<size_t>(player.slot) + 1);
+            _slotNames[static_cast<size_t>(player.slot)].alias = &player.alias;
+        }
     }
 
-    static void deansify(std::string& text)
+    /// Same as get_player_alias, but using the precomputed table
+    const std::string& lookup_player_alias(int64_t slot) const
+    {
+        static const std::string server = "Server";
+        static const std::string unknown = "Unknown";
+        if (slot == 0)
+            return server;
+        if (slot > 0 && static_cast<uint64_t>(slot) < _slotNames.size() && _slotNames[static_cast<size_t>(slot)].alias)
+            return *_slotNames[static_cast<size_t>(slot)].alias;
+        return unknown;
+    }
+
+    /// Same as get_item_name/get_location_name(id, get_player_game(player)), but using the precomputed table
+    const std::string& lookup_name(int64_t id, int player, bool item) const
+    {
+        if (player == 0)
+            return lookup_name_for_game(id, ARCHIPELAGO_GAME_ID, item);
+        if (player < 0 || static_cast<size_t>(player) >= _slotNames.size()
+                || _slotNames[static_cast<size_t>(player)].game == INVALID_GAME_ID) {
+            // old code path ("global" ids)
+            static const std::string unknown = "Unknown";
+            const auto& names = item ? _items : _locations;
+            const auto it = names.find(id);
+            if (it != names.end())
+                return it->second;
+            request_lazy_games();
+            return unknown;
+        }
+        return lookup_name_for_game(id, _slotNames[static_cast<size_t>(player)].game, item);
+    }
+
+    /// Look up id in game's table, then in Archipelago's
+    const std::string& lookup_name_for_game(int64_t id, GameId game, bool item) const
+    {
+        static const std::string unknown = "Unknown";
+        const auto& tables = item ? _gameItems : _gameLocations;
+        for (const auto gameLookup: {game, ARCHIPELAGO_GAME_ID}) {
+            request_lazy_game(gameLookup);
+            if (gameLookup < tables.size()) {
+                const auto name = tables[gameLookup].find(id);
+                if (name)
+                    return *name;
+            }
+        }
+        return unknown;
+    }
+
+    static size_t estimate_size(const std::string& s)
+    {
+        return s.capacity() > 15 ? s.capacity() + 1 : 0; // heap part; short strings are stored inline
+    }
+
+    static size_t estimate_size(const TextMessage& msg)
+    {
+        return estimate_size(msg.buffer) + msg.nodes.capacity() * sizeof(TextMessage::Node);
+    }
+
+    void add_history_entry(const json& command, bool legacy)
+    {
+        StoredHistoryEntry stored;
+        auto& entry = stored.entry;
+        entry.id = _nextHistoryId++;
+        size_t size = sizeof(StoredHistoryEntry) + 64; // indexes and deque overhead
+        if (legacy) {
+            entry.data.add_text(get_string(command, "text"));
+        } else {
+            entry.type = command.value("type", "");
+            auto it = command.find("data");
+            if (it != command.end())
+                entry.data = TextMessage::from_json(*it);
+            entry.receiving = command.value("receiving", -1);
+            entry.slot = command.value("slot", -1);
+            it = command.find("item");
+            if (it != command.end() && it->is_object()) {
+                entry.item = it->value("item", static_cast<int64_t>(INVALID_NAME_ID));
+                entry.itemPlayer = it->value("player", -1);
+            }
+        }
+        size += estimate_size(entry.data);
+        for (const auto& node: entry.data.nodes) {
+            if (node.type == TextNodeType::PLAYER_ID) {
+                if (node.id != INVALID_NAME_ID)
+                    stored.players.insert(static_cast<int>(node.id));
+            } else if (node.type == TextNodeType::ITEM_ID) {
+                if (node.id != INVALID_NAME_ID)
+                    stored.items.insert(node.id);
+                stored.players.insert(node.player);
+            } else if (node.type == TextNodeType::LOCATION_ID) {
+                stored.players.insert(node.player);
+            }
+        }
+        for (int player: {entry.receiving, entry.itemPlayer, entry.slot}) {
+            if (player >= 0)
+                stored.players.insert(player);
+        }
+        if (entry.item != INVALID_NAME_ID)
+            stored.items.insert(entry.item);
+        size += estimate_size(entry.type) + (stored.players.size() + stored.items.size()) * 48;
+        stored.size = size;
+
+        for (int player: stored.players)
+            _historyByPlayer[player].push_back(entry.id);
+        for (int64_t item: stored.items)
+            _historyByItem[item].push_back(entry.id);
+        _historyByType[entry.type].push_back(entry.id);
+        _historyMemory += size;
+        _history.push_back(std::move(stored));
+        trim_history(0);
+    }
+
+    /// Drop oldest entries until the history fits the budget, but never the entry with id keep
+    void trim_history(uint64_t keep)
+    {
+        auto unindex = [](auto& index, const auto& key, uint64_t id) {
+            auto it = index.find(key);
+            if (it == index.end())
+                return;
+            if (!it->second.empty() && it->second.front() == id)
+                it->second.pop_front();
+            if (it->second.empty())
+                index.erase(it);
+        };
+        while (_historyMemory > _historyBudget && !_history.empty() && _history.front().entry.id != keep) {
+            const auto& stored = _history.front();
+            const auto id = stored.entry.id;
+            for (int player: stored.players)
+                unindex(_historyByPlayer, player, id);
+            for (int64_t item: stored.items)
+                unindex(_historyByItem, item, id);
+            unindex(_historyByType, stored.entry.type, id);
+            _historyMemory -= stored.size;
+            for (const auto& memo: stored.rendered)
+                _historyMemory -= estimate_size(memo.text);
+            _history.pop_front();
+        }
+    }
+
+    StoredHistoryEntry* find_history_entry(uint64_t id)
+    {
+        if (_history.empty() || id < _history.front().entry.id || id > _history.back().entry.id)
+            return nullptr;
+        return &_history[static_cast<size_t>(id - _history.front().entry.id)];
+    }
+
+    const StoredHistoryEntry* find_history_entry(uint64_t id) const
+    {
+        return const_cast<APClient*>(this)->find_history_entry(id);
+    }
+
+    void update_data_storage_cache(const std::string& key, const json& value)
+    {
+        auto it = _dataStorageCache.find(key);
+        if (it == _dataStorageCache.end()) {
+            it = _dataStorageCache.emplace(key, value).first;
+        } else if (it->second != value) {
+            it->second = value;
+        } else {
+            return; // unchanged
+        }
+        if (_hOnDataStorageChanged)
+            _hOnDataStorageChanged(it->first, it->second);
+    }
+
+    bool send_get(const std::list<std::string>& keys, const json& extras)
+    {
+        if (_state < State::SLOT_CONNECTED)
+            return false;
+
+        auto packet = json{{
+            {"cmd", "Get"},
+            {"keys", keys},
+        }};
+
+        if (!extras.is_null())
+            packet[0].update(extras);
+
+        debug("> " + packet[0]["cmd"].get<std::string>() + ": " + packet.dump());
+        send_packet(packet);
+        return true;
+    }
+
+    /// Send Get and call cb for the reply, \sa see get_async
+    bool start_get_request(const std::list<std::string>& keys, std::function<void(bool success, const json& keys)> cb,
+                           unsigned long timeout, bool internal = false)
+    {
+        const uint64_t id = _nextRequestId++;
+        auto tag = request_tag(id);
+        if (internal)
+            tag[request_internal_key()] = true;
+        if (!send_get(keys, tag))
+            return false;
+        _pendingRequests[id] = {now(), timeout, "Retrieved", std::move(cb)};
+        return true;
+    }
+
+    /// Call the callback of an async request if command is a reply to one. Returns true if it was.
+    bool complete_request(const json& command, const json& result)
+    {
+        const auto nonceIt = command.find(request_nonce_key());
+        if (nonceIt == command.end() || !nonceIt->is_number_unsigned() || nonceIt->get<uint64_t>() != _requestNonce)
+            return false; // not ours, SetReply is sent to every client that subscribed to the key
+        const auto idIt = command.find(request_id_key());
+        if (idIt == command.end() || !idIt->is_number_unsigned())
+            return false;
+        const auto it = _pendingRequests.find(idIt->get<uint64_t>());
+        if (it == _pendingRequests.end())
+            return false; // timed out
+        if (command.value("cmd", "") != it->second.reply)
+            return false; // wrong type of reply
+        auto cb = std::move(it->second.cb);
+        _pendingRequests.erase(it);
+        if (cb)
+            cb(true, result);
+        return true;
+    }
+
+    void complete_connect(bool success, const json& command)
+    {
+        if (_pendingConnects.empty())
+            return;
+        auto pending = std::move(_pendingConnects.front());
+        _pendingConnects.pop_front();
+        if (pending.cb)
+            pending.cb(success, command);
+    }
+
+    void check_request_timeouts()
+    {
+        // collect first, callbacks may send new requests
+        const auto t = now();
+        std::list<std::function<void(bool, const json&)>> timedOutRequests;
+        std::list<std::function<void(bool, const std::list<NetworkItem>&)>> timedOutScouts;
+        for (auto it = _pendingRequests.begin(); it != _pendingRequests.end();) {
+            if (it->second.timeout && static_cast<unsigned long>(t - it->second.start) >= it->second.timeout) {
+                timedOutRequests.push_back(std::move(it->second.cb));
+                it = _pendingRequests.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto& pending: _pendingConnects) {
+            // timed out connects stay in the list to keep the order of replies
+            if (pending.cb && pending.timeout && static_cast<unsigned long>(t - pending.start) >= pending.timeout) {
+                timedOutRequests.push_back(std::move(pending.cb));
+                pending.cb = nullptr;
+            }
+        }
+        for (auto& pending: _pendingScouts) {
+            // timed out scouts stay in the list to keep the order of replies
+            if (pending.cb && pending.timeout && static_cast<unsigned long>(t - pending.start) >= pending.timeout) {
+                timedOutScouts.push_back(std::move(pending.cb));
+                pending.cb = nullptr;
+            }
+        }
+        for (auto& cb: timedOutRequests) {
+            if (cb)
+                cb(false, nullptr);
+        }
+        for (auto& cb: timedOutScouts)
+            cb(false, {});
+    }
+
+    void fail_pending_requests()
+    {
+        auto requests = std::move(_pendingRequests);
+        auto connects = std::move(_pendingConnects);
+        auto scouts = std::move(_pendingScouts);
+        _pendingRequests.clear();
+        _pendingConnects.clear();
+        _pendingScouts.clear();
+        for (auto& pair: requests) {
+            if (pair.second.cb)
+                pair.second.cb(false, nullptr);
+        }
+        for (auto& pending: connects) {
+            if (pending.cb)
+                pending.cb(false, nullptr);
+        }
+        for (auto& pending: scouts) {
+            if (pending.cb)
+                pending.cb(false, {});
+        }
+    }
+
+    /// Measure the round trip time with a Get of a cheap, read-only key
+    void send_rtt_probe()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        _lastRttProbe = now();
+        // don't flush batched writes for a probe, that would defeat batching and delay the reply
+        _rttProbePending = start_get_request({"_read_race_mode"}, [this, start](bool success, const json&) {
+            _rttProbePending = false;
+            if (!success)
+                return;
+            const double rtt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            _rttSamples.push_back(rtt);
+            if (_rttSamples.size() > MAX_RTT_SAMPLES)
+                _rttSamples.pop_front();
+            _rtt = (_rtt < 0) ? rtt : _rtt * 7 / 8 + rtt / 8;
+        }, std::max(_clockSyncInterval, 10000UL), true);
+    }
+
+    void check_liveness()
+    {
+        const auto silence = static_cast<unsigned long>(now() - _lastReceive);
+        if (silence >= _livenessTimeout) {
+            log("Connection timed out");
+            onclose(_wsId);
+            _reconnectNow = true;
+        } else if (silence >= _livenessTimeout / 2 && !_rttProbePending) {
+            send_rtt_probe(); // any reply will do
+        }
+    }
+
+    /// Smallest recent round trip time; least affected by queueing, so it's the best estimate for latency
+    double get_min_rtt() const
+    {
+        if (_rttSamples.empty())
+            return -1;
+        return *std::min_element(_rttSamples.begin(), _rttSamples.end());
+    }
+
+    void send_data_storage_subscriptions(const std::list<std::string>& keys)
+    {
+        SetNotify(keys);
+        if (_dataStorageCacheEnabled)
+            get_async(keys, nullptr); // values are put into the cache
+        else
+            Get(keys);
+    }
+
+    void release_data_storage_subscription(const std::string& key)
+    {
+        auto it = _dataStorageSubscriptions.find(key);
+        if (it != _dataStorageSubscriptions.end() && --it->second == 0)
+            _dataStorageSubscriptions.erase(it);
+    }
+
+    void queue_set(const std::string& key, const json& dflt, bool want_reply,
+                   const std::list<DataStorageOperation>& operations, const json& extras)
+    {
+        const bool mergeable = !want_reply && (extras.is_null() || extras.empty());
+        if (mergeable && !_pendingSets.empty()) {
+            // only merge into the last queued write, so writes to different keys stay in the order they were made
+            auto& last = _pendingSets.back();
+            if (last.key == key && !last.wantReply && (last.extras.is_null() || last.extras.empty())) {
+                for (const auto& op: operations)
+                    merge_data_storage_operation(last.operations, op);
+                return;
+            }
+        }
+        _pendingSets.push_back({key, dflt, want_reply, {}, extras});
+        for (const auto& op: operations)
+            merge_data_storage_operation(_pendingSets.back().operations, op);
+    }
+
+    static void merge_data_storage_operation(std::list<DataStorageOperation>& operations,
+                                             const DataStorageOperation& op)
+    {
+        if (op.operation == "default" && !operations.empty())
+            return; // no-op for an existing value
+        if (op.operation == "replace") {
+            operations.clear(); // previous operations don't matter anymore
+        } else if (!operations.empty() && op.value.is_number()) {
+            auto& last = operations.back();
+            if (last.operation == op.operation && last.value.is_number() &&
+                    (op.operation == "add" || op.operation == "mul")) {
+                apply_data_storage_operation(last.value, op);
+                return;
+            }
+        }
+        operations.push_back(op);
+    }
+
+    static bool is_integer(const json& j)
+    {
+        return j.is_number_integer();
+    }
+
+    static void require_numbers(const DataStorageOperation& op, const json& value)
+    {
+        if (!value.is_number() || !op.value.is_number())
+            throw_invalid_operation(op, value);
+    }
+
+    [[noreturn]] static void throw_invalid_operation(const DataStorageOperation& op, const json& value)
+    {
+        throw std::invalid_argument("Can not apply data storage operation " + op.operation +
+                                    " with " + std::string(op.value.type_name()) +
+                                    " to " + std::string(value.type_name()));
+    }
+
+    /// Operations that never change an existing value, independent of what is stored.
+    static bool is_noop_data_storage_operation(const DataStorageOperation& op)
+    {
+        const auto& v = op.value;
+        if (op.operation == "default")
+            return true;
+        if (op.operation == "add")
+            return (v.is_number() && v == 0) || (v.is_array() && v.empty()) || (v.is_string() && v == "");
+        if (op.operation == "mul" || op.operation == "pow")
+            return v.is_number() && v == 1;
+        if (op.operation == "or" || op.operation == "xor" ||
+                op.operation == "left_shift" || op.operation == "right_shift")
+            return is_integer(v) && v == 0;
+        if (op.operation == "update")
+            return (v.is_object() || v.is_array()) && v.empty();
+        return false;
+    }
+
+    static const char* color2ansi(TextColor color)
+    {
+        // ansi color command by TextColor. Each one resets first, since bold, underline and backgrounds would
+        // otherwise carry over to the following nodes.
+        static const char* const table[] = {
+            "\x1b[0m", "\x1b[0m", "\x1b[0;1m", "\x1b[0;4m",
+            "\x1b[0;30m", "\x1b[0;31m", "\x1b[0;32m", "\x1b[0;33m", "\x1b[0;34m", "\x1b[0;35m", "\x1b[0;36m",
+            "\x1b[0;37m",
+            "\x1b[0;40m", "\x1b[0;41m", "\x1b[0;42m", "\x1b[0;43m", "\x1b[0;44m", "\x1b[0;45m", "\x1b[0;46m",
+            "\x1b[0;47m",
+            "\x1b[0;38:5:219m", "\x1b[0;38:5:62m", "\x1b[0;38:5:210m", "\x1b[0;90m",
+        };
+        static_assert(sizeof(table) / sizeof(*table) == static_cast<size_t>(TextColor::GRAY) + 1,
+                      "color2ansi table does not match TextColor");
+        return table[static_cast<size_t>(color)];
+    }
+
+    static const char* color2html(TextColor color)
+    {
+        // opening span by TextColor
+        static const char* const table[] = {
+            "<span>", "<span>",
+            "<span style=\"font-weight:bold\">", "<span style=\"text-decoration:underline\">",
+            "<span style=\"color:black\">", "<span style=\"color:red\">", "<span style=\"color:green\">",
+            "<span style=\"color:yellow\">", "<span style=\"color:blue\">", "<span style=\"color:magenta\">",
+            "<span style=\"color:cyan\">", "<span style=\"color:white\">",
+            "<span style=\"background-color:black\">", "<span style=\"background-color:red\">",
+            "<span style=\"background-color:green\">", "<span style=\"background-color:yellow\">",
+            "<span style=\"background-color:blue\">", "<span style=\"background-color:magenta\">",
+            "<span style=\"background-color:cyan\">", "<span style=\"background-color:white\">",
+            "<span style=\"color:plum\">", "<span style=\"color:slateblue\">", "<span style=\"color:salmon\">",
+            "<span style=\"color:gray\">",
+        };
+        static_assert(sizeof(table) / sizeof(*table) == static_cast<size_t>(TextColor::GRAY) + 1,
+                      "color2html table does not match TextColor");
+        return table[static_cast<size_t>(color)];
+    }
+
+    static std::string take_string(json& j)
+    {
+        // move out of j if possible, throws like get<std::string>() otherwise
+        if (j.is_string())
+            return std::move(j.get_ref<std::string&>());
+        return j.get<std::string>();
+    }
+
+    static std::string take_string(json& j, const char* key)
+    {
+        auto it = j.find(key);
+        if (it == j.end())
+            return "";
+        return take_string(*it);
+    }
+
+    /// Get a reference to the string j[key] without copying it, an empty string if it is missing or not a string
+    static const std::string& get_string(const json& j, const char* key)
+    {
+        static const std::string empty;
+        auto it = j.find(key);
+        if (it == j.end() || !it->is_string())
+            return empty;
+        return it->get_ref<const std::string&>();
+    }
+
+    static void deansify(std::string& text, size_t start = 0)
     {
         // disable ansi commands in text by replacing ESC by space
-        std::replace(text.begin(), text.end(), '\x1b', ' ');
+        std::replace(text.begin() + static_cast<std::ptrdiff_t>(start), text.end(), '\x1b', ' ');
+    }
+
+    static void escape_html(std::string& out, const std::string& text)
+    {
+        escape_html(out, text.data(), text.size());
+    }
+
+    static void escape_html(std::string& out, const char* text, size_t size)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < size; i++) {
+            const char* entity;
+            switch (text[i]) {
+                case '&': entity = "&amp;"; break;
+                case '<': entity = "&lt;"; break;
+                case '>': entity = "&gt;"; break;
+                case '"': entity = "&quot;"; break;
+                case '\'': entity = "&#39;"; break;
+                default: continue;
+            }
+            out.append(text + start, i - start);
+            out += entity;
+            start = i + 1;
+        }
+        out.append(text + start, size - start);
+    }
+
+    /// Append one node to out, \sa see render_json
+    void render_node(std::string& out, TextNodeType type, TextColor color, const char* text, size_t size, int64_t id,
+                     int player, unsigned flags, unsigned hintStatus, RenderFormat fmt, bool& colorIsSet) const
+    {
+        const std::string* name = nullptr;
+        if (type == TextNodeType::PLAYER_ID) {
+            if (color == TextColor::NONE && slot_concerns_self(static_cast<int>(id))) color = TextColor::MAGENTA;
+            else if (color == TextColor::NONE) color = TextColor::YELLOW;
+            name = &lookup_player_alias(id);
+        } else if (type == TextNodeType::ITEM_ID) {
+            if (color == TextColor::NONE) {
+                if (flags & ItemFlags::FLAG_ADVANCEMENT) color = TextColor::PLUM;
+                else if (flags & ItemFlags::FLAG_NEVER_EXCLUDE) color = TextColor::SLATEBLUE;
+                else if (flags & ItemFlags::FLAG_TRAP) color = TextColor::SALMON;
+                else color = TextColor::CYAN;
+            }
+            name = &lookup_name(id, player, true);
+        } else if (type == TextNodeType::LOCATION_ID) {
+            if (color == TextColor::NONE) color = TextColor::BLUE;
+            name = &lookup_name(id, player, false);
+        } else if (type == TextNodeType::HINT_STATUS) {
+            if (hintStatus == HINT_FOUND) color = TextColor::GREEN;
+            else if (hintStatus == HINT_UNSPECIFIED) color = TextColor::GRAY;
+            else if (hintStatus == HINT_NO_PRIORITY) color = TextColor::SLATEBLUE;
+            else if (hintStatus == HINT_AVOID) color = TextColor::SALMON;
+            else if (hintStatus == HINT_PRIORITY) color = TextColor::PLUM;
+            else color = TextColor::RED;  // unknown status -> red
+        }
+        if (name) {
+            text = name->data();
+            size = name->size();
+        }
+        if (fmt == RenderFormat::ANSI) {
+            if (color == TextColor::NONE && colorIsSet) {
+                out += color2ansi(TextColor::NONE); // reset color
+                colorIsSet = false;
+            } else if (color != TextColor::NONE) {
+                out += color2ansi(color);
+                colorIsSet = true;
+            }
+            const auto start = out.size();
+            out.append(text, size);
+            deansify(out, start);
+        } else if (fmt == RenderFormat::HTML) {
+            if (color != TextColor::NONE)
+                out += color2html(color);
+            escape_html(out, text, size);
+            if (color != TextColor::NONE)
+                out += "</span>";
+        } else {
+            out.append(text, size);
+        }
+    }
+
+    /// Get the host:port part of uri
+    static std::string get_uri_host(const std::string& uri)
+    {
+        auto p = uri.find("://");
+        p = (p == std::string::npos) ? 0 : p + 3;
+        return uri.substr(p, uri.find('/', p) - p);
+    }
+
+    /// Scheme that won the last ws/wss race for a host, shared between all instances
+    static std::map<std::string, std::string>& preferred_schemes(std::unique_lock<std::mutex>& lock)
+    {
+        static std::mutex mutex;
+        static std::map<std::string, std::string> schemes;
+        lock = std::unique_lock<std::mutex>(mutex);
+        return schemes;
+    }
+
+    static std::string get_preferred_scheme(const std::string& host)
+    {
+        std::unique_lock<std::mutex> lock;
+        const auto& schemes = preferred_schemes(lock);
+        const auto it = schemes.find(host);
+        return it == schemes.end() ? "" : it->second;
+    }
+
+    static void set_preferred_scheme(const std::string& host, const std::string& scheme)
+    {
+        std::unique_lock<std::mutex> lock;
+        auto& schemes = preferred_schemes(lock);
+        if (scheme.empty())
+            schemes.erase(host);
+        else
+            schemes[host] = scheme;
     }
 
     static unsigned long now()
@@ -1790,17 +4489,103 @@ private:
 #endif
     }
 
+    /// Key added to Get and Set to match replies to async requests
+    static const char* request_id_key()
+    {
+        return "apclientpp_request_id";
+    }
+
+    /// Key added to Get and Set to tell our replies from those of other clients
+    static const char* request_nonce_key()
+    {
+        return "apclientpp_request_nonce";
+    }
+
+    /// Key added to Get for requests made by the library itself, i.e. probes
+    static const char* request_internal_key()
+    {
+        return "apclientpp_internal";
+    }
+
+    /// Extra arguments of an async request, echoed back by the server
+    json request_tag(uint64_t id) const
+    {
+        return {{request_id_key(), id}, {request_nonce_key(), _requestNonce}};
+    }
+
+    static uint64_t make_request_nonce()
+    {
+        std::random_device rd;
+        return (static_cast<uint64_t>(rd()) << 32) ^ rd();
+    }
+
+    struct PendingRequest {
+        unsigned long start;
+        unsigned long timeout;
+        const char* reply; ///< expected cmd of the reply, unused for connects
+        std::function<void(bool, const json&)> cb;
+    };
+
+    struct PendingScout {
+        unsigned long start;
+        unsigned long timeout;
+        std::function<void(bool, const std::list<NetworkItem>&)> cb;
+        std::set<int64_t> locations; ///< requested locations, the reply may contain fewer
+    };
+
+    struct ScopedTimer {
+        Histogram& histogram;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        explicit ScopedTimer(Histogram& histogram)
+            : histogram(histogram)
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            histogram.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+    };
+
+    struct SlotConnection {
+        std::string name;
+        std::string password;
+        int itemsHandling = 0;
+        std::list<std::string> tags;
+        Version version = APCLIENTPP_VERSION_INITIALIZER;
+        std::string seed; ///< room the slot was connected in
+    };
+
+    struct PendingSet {
+        std::string key;
+        json dflt;
+        bool wantReply;
+        std::list<DataStorageOperation> operations;
+        json extras;
+    };
+
     std::string _uri;
     std::string _game;
     std::string _uuid;
     std::string _certStore;
     std::unique_ptr<WS> _ws;
+    std::unique_ptr<WS> _wsRace; // alternative scheme while racing ws:// and wss://
+    std::list<std::unique_ptr<WS>> _wsRetired; // sockets to be destroyed outside of their callbacks
+    std::string _wsUri;
+    std::string _wsRaceUri;
+    unsigned _wsId = 0;
+    unsigned _wsRaceId = 0;
+    unsigned _lastWsId = 0;
+    bool _racing = false;
+    bool _raceStartPending = false; ///< the alternative scheme did not start connecting yet
     State _state = State::DISCONNECTED;
     bool _tryWSS = false;
 
     std::function<void(void)> _hOnSocketConnected = nullptr;
     std::function<void(const std::string&)> _hOnSocketError = nullptr;
     std::function<void(void)> _hOnSocketDisconnected = nullptr;
+    std::function<void(const std::string&)> _hOnLog = nullptr;
     std::function<void(const json&)> _hOnSlotConnected = nullptr;
     std::function<void(void)> _hOnSlotDisconnected = nullptr;
     std::function<void(const std::list<std::string>&)> _hOnSlotRefused = nullptr;
@@ -1809,15 +4594,24 @@ private:
     std::function<void(const std::list<NetworkItem>&)> _hOnItemsReceived = nullptr;
     std::function<void(const std::list<NetworkItem>&)> _hOnLocationInfo = nullptr;
     std::function<void(const json&)> _hOnDataPackageChanged = nullptr;
+    std::function<void(const std::string&)> _hOnGameNamesLoaded = nullptr;
     std::function<void(const std::string&)> _hOnPrint = nullptr;
     std::function<void(const json&)> _hOnPrintJson = nullptr;
+    std::function<void(json&)> _hOnPrintJsonMutable = nullptr;
     std::function<void(const json&)> _hOnBounced = nullptr;
     std::function<void(const std::list<int64_t>&)> _hOnLocationChecked = nullptr;
     std::function<void(const std::map<std::string, json>&, const json&)> _hOnRetrieved = nullptr;
+    std::function<void(const std::map<std::string, json>&)> _hOnRetrievedKeys = nullptr;
+    std::function<void(const json&, const json&)> _hOnRetrievedJson = nullptr;
     std::function<void(const json&)> _hOnSetReply = nullptr;
+    std::function<void(const std::string&, const json&)> _hOnDataStorageChanged = nullptr;
 
     unsigned long _lastSocketConnect = 0;
     unsigned long _socketReconnectInterval = 1500;
+    unsigned long _reconnectBackoff = 1500;
+    ReconnectPolicy _reconnectPolicy;
+    bool _autoReconnect = true;
+    std::mt19937 _rng{std::random_device{}()};
     bool _reconnectNow = false;
     std::set<int64_t> _checkQueue;
     std::map<int, std::set<int64_t>> _scoutQueues;
@@ -1832,13 +4626,59 @@ private:
     std::list<NetworkPlayer> _players;
     std::map<int64_t, std::string> _locations;
     std::map<int64_t, std::string> _items;
-    std::map<std::string, std::map<int64_t, std::string>> _gameLocations;
-    std::map<std::string, std::map<int64_t, std::string>> _gameItems;
+    struct LazyGame {
+        std::string checksum;
+        bool queued;
+        bool cached; ///< the store may have it, otherwise it is requested from the server right away
+    };
+
+    bool _lazyDataPackage = false;
+    bool _lazyLoadAllForGlobalIds = false;
+    mutable std::map<GameId, LazyGame> _lazyGames; ///< games that are not loaded yet in lazy mode
+    mutable std::vector<GameId> _lazyLoadQueue; ///< games that were looked up, loaded in poll()
+    std::map<std::string, GameId> _gameIds;
+    std::vector<std::string> _gameNames; ///< by GameId
+    std::vector<NameTable> _gameLocations; ///< by GameId
+    std::vector<NameTable> _gameItems; ///< by GameId
+    std::vector<SlotNames> _slotNames; ///< by slot number, \sa see update_slot_names
     bool _dataPackageValid = false;
     size_t _pendingDataPackageRequests = 0;
+    size_t _dataPackageRequestsInFlight = 0;
+    size_t _dataPackageBatchSize = 1024 * 1024;
+    size_t _dataPackageMaxInFlight = 2;
+    std::deque<std::vector<std::string>> _dataPackageBatches; ///< GetDataPackage requests that were not sent yet
+    bool _asyncDataPackage = false;
+    unsigned _dataPackageLoadThreads = 1;
+#ifndef AP_NO_THREADS
+    std::unique_ptr<LoadPool> _loadPool;
+#endif
+    std::map<std::string, GameNames> _parsedGames; ///< tables of the DataPackage that is being published
+    static constexpr size_t ASYNC_DATA_PACKAGE_MIN_SIZE = 64 * 1024; ///< smaller frames are parsed right away
+    static constexpr unsigned long ASYNC_DATA_PACKAGE_POLL_INTERVAL = 5;
     json _dataPackage;
     double _serverConnectTime = 0;
     std::chrono::steady_clock::time_point _localConnectTime;
+    static constexpr size_t MAX_RTT_SAMPLES = 8;
+    static constexpr unsigned long SCHEME_RACE_HEAD_START = 300; ///< ms before the alternative scheme is tried
+    unsigned long _clockSyncInterval = 0;
+    unsigned long _lastRttProbe = 0;
+    bool _rttProbePending = false;
+    size_t _historyBudget = 0;
+    size_t _historyMemory = 0;
+    uint64_t _nextHistoryId = 1;
+    uint64_t _renderGeneration = 0; ///< changes when names used by render_json change
+    std::deque<StoredHistoryEntry> _history;
+    std::map<int, std::deque<uint64_t>> _historyByPlayer;
+    std::map<int64_t, std::deque<uint64_t>> _historyByItem;
+    std::map<std::string, std::deque<uint64_t>> _historyByType;
+    Metrics _metrics;
+    bool _wasConnected = false;
+    bool _connectStartValid = false;
+    std::chrono::steady_clock::time_point _connectStart;
+    unsigned long _livenessTimeout = 0;
+    unsigned long _lastReceive = 0;
+    std::deque<double> _rttSamples;
+    double _rtt = -1;
     Version _serverVersion = {0,0,0};
     Version _generatorVersion = {0,0,0};
     int _locationCount = 0;
@@ -1846,42 +4686,84 @@ private:
     int _hintPoints = 0;
     std::map<std::string, Permission> _commandPermissions;
     bool _receiveOwnLocations = false;
+    bool _autoResume = false;
+    bool _resumeValid = false; // _resume was accepted by the server
+    bool _resuming = false;
+    SlotConnection _resume;
+    bool _dataStorageCacheEnabled = false;
+    bool _dataStorageWriteBatching = false;
+    unsigned long _dataStorageFlushInterval = 0;
+    unsigned long _lastDataStorageFlush = 0;
+    std::string _dataStorageCacheSeed;
+    std::map<std::string, json> _dataStorageCache;
+    std::list<PendingSet> _pendingSets;
+    std::map<std::string, std::set<std::string>> _dataStorageSubscribers; // subscriber -> keys
+    std::map<std::string, unsigned> _dataStorageSubscriptions; // key -> number of subscribers
+    std::set<std::string> _notifiedKeys; // keys sent in SetNotify on the current connection
+    uint64_t _nextRequestId = 1;
+    uint64_t _requestNonce = make_request_nonce();
+    std::map<uint64_t, PendingRequest> _pendingRequests;
+    std::list<PendingRequest> _pendingConnects;
+    std::list<PendingScout> _pendingScouts;
     std::set<int64_t> _checkedLocations;
     std::set<int64_t> _missingLocations;
     APDataPackageStore* _dataPackageStore;
 #ifndef AP_NO_DEFAULT_DATA_PACKAGE_STORE
     std::unique_ptr<APDataPackageStore> _autoDataPackageStore;
 #endif
+    std::mutex _dataPackageStoreMutex;
     std::map<int, NetworkSlot> _slotInfo;
 
 #ifndef AP_NO_SCHEMA
-    const json _packetSchemaJson = R"({
-        "type": "array",
-        "items": {
-            "type": "object",
-            "properties": {
-                "cmd": { "type": "string" }
-            },
-            "required": [ "cmd" ]
-        }
-    })"_json;
-    valijson::Schema _packetSchema;
-
-    const json _retrievedSchemaJson = R"({
-        "type": "object",
-        "properties": {
-            "keys": { "type": "object" }
-        },
-        "required": [ "keys" ]
-    })"_json;
-    const json _setReplySchemaJson = R"({
-        "type": "object",
-        "properties": {
-            "key": { "type": "string" }
-        },
-        "required": [ "key", "value" ]
-    })"_json;
-    std::map<std::string, valijson::Schema> _commandSchemas;
+    /// Parsed schemas are immutable and shared by all instances
+    struct Schemas {
+        valijson::Schema packet;
+        std::map<std::string, valijson::Schema> commands;
+
+        Schemas()
+        {
+            const json packetJson = R"({
+                "type": "array",
+                "items": {
+                    "type": "object",
+                    "properties": {
+                        "cmd": { "type": "string" }
+                    },
+                    "required": [ "cmd" ]
+                }
+            })"_json;
+            const json retrievedJson = R"({
+                "type": "object",
+                "properties": {
+                    "keys": { "type": "object" }
+                },
+                "required": [ "keys" ]
+            })"_json;
+            const json setReplyJson = R"({
+                "type": "object",
+                "properties": {
+                    "key": { "type": "string" }
+                },
+                "required": [ "key", "value" ]
+            })"_json;
+
+            valijson::SchemaParser parser;
+            parser.populateSchema(JsonSchemaAdapter(packetJson), packet);
+            parser.populateSchema(JsonSchemaAdapter(retrievedJson), commands["Retrieved"]);
+            parser.populateSchema(JsonSchemaAdapter(setReplyJson), commands["SetReply"]);
+        }
+    };
+
+    static const Schemas& schemas()
+    {
+        static const Schemas instance; // initialization is thread-safe
+        return instance;
+    }
+#endif
+
+#ifndef AP_NO_THREADS
+    // declared last, so running jobs are waited for before the store is destroyed
+    std::deque<std::future<ParsedDataPackage>> _dataPackageJobs;
 #endif
 };
 
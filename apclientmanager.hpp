@@ -0,0 +1,395 @@
+/* Copyright (c) 2022-2025 black-sliver, FelicitusNeko, highrow623, NewSoupVi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _APCLIENTMANAGER_HPP
+#define _APCLIENTMANAGER_HPP
+
+/*
+ * NOTE: this is optional and requires threads.
+ * Sessions are pinned to one worker thread each. All callbacks of a session run on that thread, in order,
+ * so a session never has to be locked. Use `post()` to interact with a session from other threads.
+ * There is no shared I/O context: wswrap owns one socket and I/O context per session and does not expose them, so
+ * socket readiness can't wake a worker. Instead each session is polled when its `APClient::next_wakeup()` is due,
+ * but at least once per poll interval while it has a socket, and each worker sleeps until the earliest of these
+ * deadlines of its sessions. The cost of idle connected sessions therefore grows with their number divided by the
+ * poll interval. Raise the poll interval for large numbers of mostly idle sessions.
+ */
+
+#if defined __EMSCRIPTEN__ && !defined __EMSCRIPTEN_PTHREADS__
+#error "apclientmanager.hpp requires pthreads"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "apclient.hpp"
+
+
+/**
+ * Thread-safe data package store that wraps another store.
+ *
+ * The most recently used data packages are kept in memory, so sessions playing the same games
+ * don't read and parse the same files over and over.
+ */
+class SharedDataPackageStore : public APDataPackageStore {
+public:
+    /// Wrap `store`, keeping up to `maxGames` data packages in memory
+    explicit SharedDataPackageStore(APDataPackageStore* store, size_t maxGames = 64)
+        : _store(store), _maxGames(maxGames)
+    {
+    }
+
+    bool load(const std::string& game, const std::string& checksum, json& data) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = find(game, checksum);
+        if (it != _games.end()) {
+            data = it->second.data;
+            return true;
+        }
+        if (!_store || !_store->load(game, checksum, data))
+            return false;
+        remember(game, data);
+        return true;
+    }
+
+    bool contains(const std::string& game, const std::string& checksum) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (find(game, checksum) != _games.end())
+            return true;
+        return _store && _store->contains(game, checksum);
+    }
+
+    bool save(const std::string& game, const json& data) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        remember(game, data);
+        return _store ? _store->save(game, data) : true;
+    }
+
+    size_t get_size_hint(const std::string& game) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _store ? _store->get_size_hint(game) : 0;
+    }
+
+    bool is_thread_safe() const override
+    {
+        return true;
+    }
+
+    /// Set the number of data packages kept in memory. 0 disables keeping them.
+    void set_max_games(size_t maxGames)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _maxGames = maxGames;
+        trim(_maxGames);
+    }
+
+    /// Get the number of data packages that are kept in memory
+    size_t get_max_games()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _maxGames;
+    }
+
+private:
+    struct Entry {
+        json data;
+        std::list<std::string>::iterator lru;
+    };
+
+    /// Find a game with matching checksum and mark it as most recently used
+    std::map<std::string, Entry>::iterator find(const std::string& game, const std::string& checksum)
+    {
+        auto it = _games.find(game);
+        if (it == _games.end() || it->second.data.value("checksum", "") != checksum)
+            return _games.end();
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+        return it;
+    }
+
+    void remember(const std::string& game, const json& data)
+    {
+        auto it = _games.find(game);
+        if (it != _games.end()) {
+            it->second.data = data;
+            _lru.splice(_lru.begin(), _lru, it->second.lru);
+            return;
+        }
+        if (!_maxGames)
+            return;
+        trim(_maxGames - 1);
+        _lru.push_front(game);
+        _games.emplace(game, Entry{data, _lru.begin()});
+    }
+
+    /// Drop least recently used games until at most `count` are left
+    void trim(size_t count)
+    {
+        while (_games.size() > count) {
+            _games.erase(_lru.back());
+            _lru.pop_back();
+        }
+    }
+
+    std::mutex _mutex;
+    APDataPackageStore* _store;
+    size_t _maxGames;
+    std::map<std::string, Entry> _games;
+    std::list<std::string> _lru; ///< keys of _games, most recently used first
+};
+
+
+/**
+ * Hosts many APClient sessions on a small pool of worker threads.
+ *
+ * Create sessions with `add_session`, install handlers in its setup function and interact with it through `post`.
+ */
+class APClientManager final {
+public:
+    typedef size_t SessionId;
+    typedef std::function<void(APClient&)> Task;
+    /// Receives log messages of sessions (error = false) and exceptions thrown by their tasks and handlers
+    /// (error = true)
+    typedef std::function<void(SessionId id, bool error, const std::string& msg)> LogHandler;
+
+    /// Create a manager with `workers` threads (0 = hardware concurrency).
+    /// `pollInterval` is the longest a worker sleeps while a socket is open, i.e. the receive latency.
+    /// All sessions share `dataPackageStore` (or a DefaultDataPackageStore if none is given) through a
+    /// SharedDataPackageStore.
+    explicit APClientManager(size_t workers = 0, unsigned long pollInterval = 10,
+                             APDataPackageStore* dataPackageStore = nullptr)
+        : _pollInterval(pollInterval)
+    {
+        if (!dataPackageStore) {
+        #ifndef AP_NO_DEFAULT_DATA_PACKAGE_STORE
+            _autoDataPackageStore.reset(new DefaultDataPackageStore());
+            dataPackageStore = _autoDataPackageStore.get();
+        #endif
+        }
+        _dataPackageStore.reset(new SharedDataPackageStore(dataPackageStore));
+        if (workers == 0)
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < workers; i++)
+            _workers.emplace_back(new Worker());
+        for (auto& worker: _workers)
+            worker->thread = std::thread(&APClientManager::run, this, worker.get());
+    }
+
+    APClientManager(const APClientManager&) = delete;
+    APClientManager& operator=(const APClientManager&) = delete;
+
+    /// Stops all workers and destroys all sessions
+    ~APClientManager()
+    {
+        for (auto& worker: _workers) {
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                worker->stop = true;
+            }
+            worker->cv.notify_one();
+        }
+        for (auto& worker: _workers)
+            worker->thread.join();
+    }
+
+    /// Add a session. `setup` runs on the session's worker before the first poll, use it to install handlers.
+    SessionId add_session(const std::string& uuid, const std::string& game, const std::string& uri,
+                          Task setup = nullptr, const std::string& certStore = "")
+    {
+        const SessionId id = _nextSessionId++;
+        std::shared_ptr<APClient> client(new APClient(uuid, game, uri, certStore, _dataPackageStore.get()));
+        _sessionCount++; // before the worker can remove it again
+        push(id, [id, client, setup, this](Worker& worker) {
+            worker.sessions[id].client = client;
+            client->set_log_handler([id, this](const std::string& msg) {
+                log(id, false, msg);
+            });
+            if (setup)
+                setup(*client);
+        });
+        return id;
+    }
+
+    /// Disconnect and destroy a session. Tasks that were posted before still run.
+    void remove_session(SessionId id)
+    {
+        push(id, [id, this](Worker& worker) {
+            if (worker.sessions.erase(id))
+                _sessionCount--;
+        });
+    }
+
+    /// Run `task` on the session's worker. Tasks of a session run in the order they were posted.
+    void post(SessionId id, Task task)
+    {
+        push(id, [id, task](Worker& worker) {
+            auto it = worker.sessions.find(id);
+            if (it != worker.sessions.end())
+                task(*it->second.client);
+        });
+    }
+
+    /// Get the number of sessions
+    size_t size() const
+    {
+        return _sessionCount;
+    }
+
+    /// Get the number of worker threads
+    size_t get_worker_count() const
+    {
+        return _workers.size();
+    }
+
+    /// Set a handler for log messages of all sessions and for exceptions thrown by their tasks and handlers.
+    /// Calls are serialized, but happen on the worker threads. Without a handler, log messages are printed to
+    /// stdout and exceptions to stderr.
+    void set_log_handler(LogHandler f)
+    {
+        std::lock_guard<std::mutex> lock(_logMutex);
+        _hOnLog = std::move(f);
+    }
+
+    /// Get the store that is shared by all sessions
+    SharedDataPackageStore* get_data_package_store()
+    {
+        return _dataPackageStore.get();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Session {
+        std::shared_ptr<APClient> client;
+        Clock::time_point nextPoll = Clock::time_point::min();
+    };
+
+    struct Worker {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::pair<SessionId, std::function<void(Worker&)>>> tasks; // guarded by mutex
+        bool stop = false; // guarded by mutex
+        std::map<SessionId, Session> sessions; // only used by thread
+    };
+
+    Worker& get_worker(SessionId id)
+    {
+        return *_workers[id % _workers.size()];
+    }
+
+    void push(SessionId id, std::function<void(Worker&)> task)
+    {
+        auto& worker = get_worker(id);
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.emplace_back(id, std::move(task));
+        }
+        worker.cv.notify_one();
+    }
+
+    void run(Worker* worker)
+    {
+        std::deque<std::pair<SessionId, std::function<void(Worker&)>>> tasks;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                if (worker->stop)
+                    break;
+                std::swap(tasks, worker->tasks);
+            }
+            for (auto& task: tasks) {
+                run_guarded(task.first, [&task, worker] { task.second(*worker); });
+                auto it = worker->sessions.find(task.first);
+                if (it != worker->sessions.end())
+                    it->second.nextPoll = Clock::time_point::min(); // the task may have queued work
+            }
+            tasks.clear();
+
+            // only poll sessions that are due and sleep until the next one is
+            const auto now = Clock::now();
+            auto wakeup = Clock::time_point::max();
+            for (auto& pair: worker->sessions) {
+                auto& session = pair.second;
+                if (session.nextPoll <= now) {
+                    run_guarded(pair.first, [&session] { session.client->poll(); }); // handlers run from poll
+                    auto delay = session.client->next_wakeup();
+                    if (session.client->get_state() > APClient::State::DISCONNECTED)
+                        delay = std::min(delay, _pollInterval); // incoming data is only seen by poll
+                    session.nextPoll = delay == std::numeric_limits<unsigned long>::max() ? Clock::time_point::max()
+                            : now + std::chrono::milliseconds(delay);
+                }
+                wakeup = std::min(wakeup, session.nextPoll);
+            }
+
+            std::unique_lock<std::mutex> lock(worker->mutex);
+            if (wakeup == Clock::time_point::max()) {
+                worker->cv.wait(lock, [worker] { return worker->stop || !worker->tasks.empty(); });
+            } else if (wakeup > Clock::now()) {
+                worker->cv.wait_until(lock, wakeup, [worker] { return worker->stop || !worker->tasks.empty(); });
+            }
+        }
+        worker->sessions.clear(); // disconnect on the thread that owns the sessions
+    }
+
+    /// Run f and log exceptions, so a session can't end the worker thread and with that the process
+    template<class F>
+    void run_guarded(SessionId id, F&& f)
+    {
+        try {
+            f();
+        } catch (const std::exception& ex) {
+            log(id, true, ex.what());
+        } catch (...) {
+            log(id, true, "unknown exception");
+        }
+    }
+
+    void log(SessionId id, bool error, const std::string& msg)
+    {
+        std::lock_guard<std::mutex> lock(_logMutex);
+        if (_hOnLog)
+            _hOnLog(id, error, msg);
+        else if (error)
+            fprintf(stderr, "APClientManager: session %zu: %s\n", id, msg.c_str());
+        else
+            printf("APClient %zu: %s\n", id, msg.c_str());
+    }
+
+    unsigned long _pollInterval;
+    std::mutex _logMutex;
+    LogHandler _hOnLog; // guarded by _logMutex
+    std::atomic<SessionId> _nextSessionId{0};
+    std::atomic<size_t> _sessionCount{0};
+#ifndef AP_NO_DEFAULT_DATA_PACKAGE_STORE
+    std::unique_ptr<APDataPackageStore> _autoDataPackageStore;
+#endif
+    std::unique_ptr<SharedDataPackageStore> _dataPackageStore;
+    std::vector<std::unique_ptr<Worker>> _workers;
+};
+
+#endif // _APCLIENTMANAGER_HPP
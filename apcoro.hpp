@@ -0,0 +1,160 @@
+/* Copyright (c) 2022-2025 black-sliver, FelicitusNeko, highrow623, NewSoupVi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef _APCORO_HPP
+#define _APCORO_HPP
+
+/*
+ * NOTE: this is optional and requires C++20. apclient.hpp itself stays C++14.
+ * The awaitables work with any coroutine/task type. They are resumed from within APClient::poll(),
+ * so the coroutine continues on the thread that calls poll().
+ * The APClient instance has to outlive all coroutines that are suspended on it.
+ */
+
+#if !defined __cpp_impl_coroutine || __cpp_impl_coroutine < 201902L
+#error "apcoro.hpp requires C++20 coroutine support"
+#endif
+
+#include <coroutine>
+#include <functional>
+#include <list>
+#include <string>
+#include <utility>
+#include "apclient.hpp"
+
+
+namespace AP {
+    struct ConnectSlotResult {
+        bool success = false;
+        nlohmann::json slotData; ///< slot_data if successful
+        std::list<std::string> errors; ///< errors if refused, empty on timeout or disconnect
+    };
+
+    struct GetResult {
+        bool success = false;
+        nlohmann::json keys;
+    };
+
+    struct SetResult {
+        bool success = false;
+        nlohmann::json reply; ///< the SetReply command
+    };
+
+    struct ScoutResult {
+        bool success = false;
+        std::list<APClient::NetworkItem> items;
+    };
+
+    /**
+     * Awaitable for a single request/response flow of APClient.
+     * If the request can not be sent, the coroutine does not suspend and the result is unsuccessful.
+     */
+    template<class Result>
+    class Awaitable {
+    public:
+        typedef std::function<void(Result)> Completion;
+        typedef std::function<bool(Completion)> Start;
+
+        explicit Awaitable(Start start)
+            : _start(std::move(start))
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            _handle = handle;
+            return _start([this](Result result) {
+                _result = std::move(result);
+                _handle.resume();
+            });
+        }
+
+        Result await_resume()
+        {
+            return std::move(_result);
+        }
+
+    private:
+        Start _start;
+        std::coroutine_handle<> _handle;
+        Result _result;
+    };
+
+    /// co_await ConnectSlot -> Connected or ConnectionRefused
+    inline Awaitable<ConnectSlotResult> connect_slot(APClient& ap, std::string name, std::string password,
+                                                     int items_handling, std::list<std::string> tags = {},
+                                                     APClient::Version ver = APCLIENTPP_VERSION_INITIALIZER,
+                                                     unsigned long timeout = 0)
+    {
+        return Awaitable<ConnectSlotResult>([&ap, name = std::move(name), password = std::move(password),
+                                             items_handling, tags = std::move(tags), ver, timeout]
+                                            (Awaitable<ConnectSlotResult>::Completion done) {
+            return ap.connect_slot_async(name, password, items_handling, tags, ver,
+                    [done = std::move(done)](bool success, const nlohmann::json& reply) {
+                ConnectSlotResult result;
+                result.success = success;
+                if (success) {
+                    auto it = reply.find("slot_data");
+                    if (it != reply.end())
+                        result.slotData = *it;
+                } else if (reply.is_object()) {
+                    auto it = reply.find("errors");
+                    if (it != reply.end() && it->is_array()) {
+                        for (const auto& error: *it)
+                            result.errors.push_back(error.get<std::string>());
+                    }
+                }
+                done(std::move(result));
+            }, timeout);
+        });
+    }
+
+    /// co_await Get -> Retrieved
+    inline Awaitable<GetResult> get(APClient& ap, std::list<std::string> keys, unsigned long timeout = 0)
+    {
+        return Awaitable<GetResult>([&ap, keys = std::move(keys), timeout](Awaitable<GetResult>::Completion done) {
+            return ap.get_async(keys, [done = std::move(done)](bool success, const nlohmann::json& keys) {
+                done({success, keys});
+            }, timeout);
+        });
+    }
+
+    /// co_await Set with want_reply -> SetReply
+    inline Awaitable<SetResult> set(APClient& ap, std::string key, nlohmann::json dflt,
+                                    std::list<APClient::DataStorageOperation> operations, unsigned long timeout = 0)
+    {
+        return Awaitable<SetResult>([&ap, key = std::move(key), dflt = std::move(dflt),
+                                     operations = std::move(operations), timeout]
+                                    (Awaitable<SetResult>::Completion done) {
+            return ap.set_async(key, dflt, operations, [done = std::move(done)](bool success, const nlohmann::json& reply) {
+                done({success, reply});
+            }, timeout);
+        });
+    }
+
+    /// co_await LocationScouts -> LocationInfo
+    inline Awaitable<ScoutResult> scout(APClient& ap, std::list<int64_t> locations, int create_as_hint = 0,
+                                        unsigned long timeout = 0)
+    {
+        return Awaitable<ScoutResult>([&ap, locations = std::move(locations), create_as_hint, timeout]
+                                      (Awaitable<ScoutResult>::Completion done) {
+            return ap.scout_async(locations, create_as_hint,
+                    [done = std::move(done)](bool success, const std::list<APClient::NetworkItem>& items) {
+                done({success, items});
+            }, timeout);
+        });
+    }
+} // namespace AP
+
+#endif // _APCORO_HPP
@@ -11,17 +11,23 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 #define _DEFAULTDATAPACKAGESTORE_HPP
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
+#include <functional>
 #include <string>
+#include <thread>
 #include <nlohmann/json.hpp>
 #include "apclient.hpp"
 
 #if defined WIN32 || defined _WIN32
+#include <process.h>
 #include <shlobj.h>
 #include <sys/utime.h>
 #else
+#include <sys/stat.h>
+#include <unistd.h>
 #include <utime.h>
 #endif
 
@@ -148,6 +154,12 @@ done:
             return s + slash() + other;
         }
 
+        path& operator+=(const TString& other)
+        {
+            s += other;
+            return *this;
+        }
+
 #if defined WIN32 || defined _WIN32
         path operator/(const std::string& other) const
         {
@@ -226,6 +238,41 @@ done:
 #endif
     }
 
+    /// Replace to by from. Readers see either the old or the new file.
+    static bool replace_file(const path& from, const path& to)
+    {
+#ifndef NO_STD_FILESYSTEM
+        std::error_code ec;
+        std::filesystem::rename(from, to, ec);
+        return !ec;
+#elif defined WIN32 || defined _WIN32
+        return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+
+    static unsigned long get_pid()
+    {
+#if defined WIN32 || defined _WIN32
+        return static_cast<unsigned long>(_getpid());
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+
+    static void remove_file(const path& p)
+    {
+#ifndef NO_STD_FILESYSTEM
+        std::error_code ec;
+        std::filesystem::remove(p, ec);
+#elif defined WIN32 || defined _WIN32
+        _wremove(p.c_str());
+#else
+        std::remove(p.c_str());
+#endif
+    }
+
     static path get_default_cache_dir(const std::string& fallbackPath, const std::string& app = "Archipelago")
     {
 #if defined WIN32 || defined _WIN32
@@ -287,6 +334,60 @@ public:
         }
     }
 
+    /// Only checks if the file exists and is not empty, without opening it
+    bool contains(const std::string& game, const std::string& checksum) override
+    {
+        auto p = get_path(game, checksum);
+        if (p.empty())
+            return false;
+#ifdef NO_STD_FILESYSTEM
+        std::ifstream f(p.c_str(), std::ios::binary);
+        return f.good() && f.peek() != std::ifstream::traits_type::eof();
+#else
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(p, ec);
+        return !ec && size > 0;
+#endif
+    }
+
+    size_t get_size_hint(const std::string& game) override
+    {
+#ifdef NO_STD_FILESYSTEM
+        (void)game;
+        return 0; // would need to list the directory
+#else
+        // size of the most recently used version
+        auto dir = get_path(game, "_").parent_path();
+        if (dir.empty())
+            return 0;
+        std::error_code ec;
+        size_t size = 0;
+        auto newest = std::filesystem::file_time_type::min();
+        // range-for would use operator++, which throws
+        for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            const auto& entry = *it;
+            if (entry.path().extension() != ".json")
+                continue; // being saved
+            std::error_code entryEc;
+            const auto time = entry.last_write_time(entryEc);
+            if (entryEc || !entry.is_regular_file(entryEc) || time < newest)
+                continue;
+            const auto fileSize = entry.file_size(entryEc);
+            if (entryEc)
+                continue;
+            newest = time;
+            size = static_cast<size_t>(fileSize);
+        }
+        return size;
+#endif
+    }
+
+    /// Calls don't share state and save replaces files atomically, so a concurrent load sees a complete file
+    bool is_thread_safe() const override
+    {
+        return true;
+    }
+
     bool save(const std::string& game, const json& data) override
     {
 #ifndef NO_STD_FILESYSTEM
@@ -311,16 +412,44 @@ public:
             return false;
         }
 
+        // write to a unique temporary file first, so other threads and processes never see a partial file
+        path tmp;
         try {
+            // unique across processes, threads and calls of this process
+            static std::atomic<unsigned> counter{0};
+            const std::string suffix = ".tmp" + std::to_string(get_pid()) + "-" +
+                    std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "-" +
+                    std::to_string(counter++);
+            tmp = p;
+#if defined WIN32 || defined _WIN32
+            tmp += std::wstring(suffix.begin(), suffix.end());
+#else
+            tmp += suffix;
+#endif
+            {
 #ifdef NO_STD_FILESYSTEM
-            std::ofstream f(p.c_str(), std::ios::binary);
+                std::ofstream f(tmp.c_str(), std::ios::binary);
 #else
-            std::ofstream f(p, std::ios::binary);
+                std::ofstream f(tmp, std::ios::binary);
 #endif
-            f << data.dump();
+                f << data.dump();
+                f.close();
+                if (f.fail()) {
+                    log(("Could not write " + tmp.string()).c_str());
+                    remove_file(tmp);
+                    return false;
+                }
+            }
+            if (!replace_file(tmp, p)) {
+                log(("Could not replace " + p.string()).c_str());
+                remove_file(tmp);
+                return false;
+            }
             return true;
         } catch (const std::exception& ex) {
             log(ex.what());
+            if (!tmp.empty())
+                remove_file(tmp);
             return false;
         }
     }
@@ -0,0 +1,143 @@
+// Scripted stand-in for wswrap, for tests that need sockets the test server can not provide, like wss://.
+// Sockets do not connect anywhere: they open or fail after the delay set for their scheme with mock_scheme().
+
+#ifndef _WSWRAP_HPP
+#define _WSWRAP_HPP
+
+#define WSWRAP_VERSION 10300
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace wswrap {
+
+struct MockScheme {
+    enum class Result {
+        OPEN,
+        FAIL,
+        HANG, ///< never opens or fails
+    };
+
+    Result result = Result::FAIL;
+    unsigned long delay = 0; ///< ms after creation until the socket opens or fails
+};
+
+/// Behavior of sockets by scheme. Schemes that were not set fail right away.
+inline std::map<std::string, MockScheme>& mock_schemes()
+{
+    static std::map<std::string, MockScheme> schemes;
+    return schemes;
+}
+
+inline void mock_scheme(const std::string& scheme, MockScheme::Result result, unsigned long delay = 0)
+{
+    mock_schemes()[scheme] = {result, delay};
+}
+
+/// URIs of all sockets in order of creation
+inline std::vector<std::string>& mock_connects()
+{
+    static std::vector<std::string> connects;
+    return connects;
+}
+
+/// URIs of sockets that are open and not destroyed yet
+inline std::vector<std::string>& mock_open_sockets()
+{
+    static std::vector<std::string> open;
+    return open;
+}
+
+class WS final {
+public:
+    typedef std::function<void(void)> onopen_handler;
+    typedef std::function<void(void)> onclose_handler;
+    typedef std::function<void(const std::string&)> onmessage_handler;
+    typedef std::function<void(const std::string&)> onerror_handler;
+
+    WS(const std::string& uri, onopen_handler hopen, onclose_handler hclose, onmessage_handler hmessage,
+       onerror_handler herror, const std::string& certStore = "")
+        : _uri(uri), _hopen(std::move(hopen)), _hclose(std::move(hclose)), _herror(std::move(herror)),
+          _start(std::chrono::steady_clock::now())
+    {
+        (void)hmessage;
+        (void)certStore;
+        const auto scheme = uri.substr(0, uri.find("://"));
+        const auto it = mock_schemes().find(scheme);
+        if (it != mock_schemes().end())
+            _scheme = it->second;
+        mock_connects().push_back(uri);
+    }
+
+    ~WS()
+    {
+        if (_state == State::OPEN)
+            remove_open();
+    }
+
+    void poll()
+    {
+        if (_state != State::CONNECTING || _scheme.result == MockScheme::Result::HANG)
+            return;
+        const auto elapsed = std::chrono::steady_clock::now() - _start;
+        if (elapsed < std::chrono::milliseconds(_scheme.delay))
+            return;
+        if (_scheme.result == MockScheme::Result::OPEN) {
+            _state = State::OPEN;
+            mock_open_sockets().push_back(_uri);
+            if (_hopen)
+                _hopen();
+        } else {
+            _state = State::CLOSED;
+            if (_herror)
+                _herror("connection refused");
+            if (_hclose)
+                _hclose();
+        }
+    }
+
+    void send(const std::string&)
+    {
+        if (_state != State::OPEN)
+            throw std::runtime_error("send on closed socket");
+    }
+
+    unsigned long get_ok_connect_interval() const
+    {
+        return 0;
+    }
+
+private:
+    enum class State {
+        CONNECTING,
+        OPEN,
+        CLOSED,
+    };
+
+    void remove_open()
+    {
+        auto& open = mock_open_sockets();
+        for (auto it = open.begin(); it != open.end(); ++it) {
+            if (*it == _uri) {
+                open.erase(it);
+                break;
+            }
+        }
+    }
+
+    std::string _uri;
+    onopen_handler _hopen;
+    onclose_handler _hclose;
+    onerror_handler _herror;
+    std::chrono::steady_clock::time_point _start;
+    MockScheme _scheme;
+    State _state = State::CONNECTING;
+};
+
+} // namespace wswrap
+
+#endif // _WSWRAP_HPP
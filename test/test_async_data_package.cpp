@@ -0,0 +1,211 @@
+// Tests the async data package: commands received after a large DataPackage frame are handled while the frame is
+// still being parsed, its names are published by a later poll(), and a frame that is still being parsed when the
+// connection is lost is dropped instead of replacing names received after the reconnect.
+
+#include <apclient.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <string>
+#include "testserver.hpp"
+
+static const json packageGames = {
+    {"Archipelago", make_game_data("Archipelago", -10, 5)},
+    {"Game A", make_game_data("Game A", 1000, 3)},
+};
+
+/// Store that blocks the first save until released, which holds the worker thread of the first DataPackage.
+/// Store access is serialized, so the client can not access the store until it is released.
+class BlockingDataPackageStore final : public APDataPackageStore {
+public:
+    bool load(const std::string& game, const std::string& checksum, json& data) override
+    {
+        return store.load(game, checksum, data);
+    }
+
+    bool contains(const std::string& game, const std::string& checksum) override
+    {
+        return store.contains(game, checksum);
+    }
+
+    bool save(const std::string& game, const json& data) override
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!blocked) {
+                blocked = true;
+                cv.wait(lock, [this] { return released; });
+            }
+        }
+        return store.save(game, data);
+    }
+
+    bool is_blocked()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return blocked && !released;
+    }
+
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            released = true;
+        }
+        cv.notify_all();
+    }
+
+    MemoryDataPackageStore store;
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool blocked = false;
+    bool released = false;
+};
+
+static std::atomic<int> connections{0};
+static BlockingDataPackageStore store; // released by the server when the client connects again
+static std::atomic<bool> blockedOnReconnect{false};
+
+static std::mutex orderMutex;
+static bool dataPackageSent = false; // guarded by orderMutex
+static bool connectedSent = false; // guarded by orderMutex
+
+/// Send the DataPackage as one large frame and ReceivedItems once both DataPackage and Connected are out
+static void on_message_ordered(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(orderMutex);
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            server.send(hdl, json::array({make_connected_for({"Game A"})}).dump());
+            connectedSent = true;
+        } else if (cmd == "GetDataPackage") {
+            // large enough to be parsed on a worker thread
+            const json games = {
+                {"Archipelago", packageGames["Archipelago"]},
+                {"Game A", make_game_data("Game A", 1000, 2000)},
+            };
+            server.send(hdl, json::array({{{"cmd", "DataPackage"}, {"data", {{"games", games}}}}}).dump());
+            dataPackageSent = true;
+        } else {
+            continue;
+        }
+        if (dataPackageSent && connectedSent) {
+            const json items = {{{"item", 1000}, {"location", 1001}, {"player", 1}, {"flags", 0}}};
+            server.send(hdl, json::array({{{"cmd", "ReceivedItems"}, {"index", 0}, {"items", items}}}).dump());
+        }
+    }
+}
+
+static void test_commands_before_publish()
+{
+    ScopedTestServer server{[](TestServer& server, const websocketpp::connection_hdl& hdl) {
+        server.send(hdl, json::array({make_room_info({"Game A"}, get_checksums(packageGames))}).dump());
+    }, on_message_ordered};
+    const std::string uri = server.get_uri();
+
+    BlockingDataPackageStore blockingStore;
+    bool error = false;
+    bool itemsReceived = false;
+    std::string nameInHandler;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "Game A", uri, "", &blockingStore};
+        ap.set_async_data_package(true);
+        connect_on_room_info(ap, error);
+        ap.set_items_received_handler([&](const std::list<APClient::NetworkItem>& items) {
+            itemsReceived = true;
+            nameInHandler = ap.get_item_name(items.front().item, "Game A");
+        });
+
+        check(poll_until(ap, [&]() { return error || itemsReceived; }), "Timeout waiting for ReceivedItems");
+        check(nameInHandler == "Unknown", "DataPackage was published before ReceivedItems: " + nameInHandler);
+
+        // nothing is published while the worker is held
+        check(poll_until(ap, [&]() { return error || blockingStore.is_blocked(); }),
+              "DataPackage was not parsed on a worker thread");
+        poll_until(ap, []() { return false; }, std::chrono::milliseconds(50));
+        check(ap.get_item_name(1000, "Game A") == "Unknown", "DataPackage was published while being parsed");
+
+        // the names are published by a poll() once the worker is done
+        blockingStore.release();
+        check(poll_until(ap, [&]() { return error || ap.get_item_name(1000, "Game A") == "Game A Item 0"; }),
+              "DataPackage was not published: " + ap.get_item_name(1000, "Game A"));
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+}
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    if (++connections == 2) {
+        blockedOnReconnect = store.is_blocked();
+        store.release();
+    }
+    server.send(hdl, json::array({make_room_info({"Game A"}, get_checksums(packageGames))}).dump());
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    bool drop = false;
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected_for({"Game A"}));
+        } else if (cmd == "GetDataPackage" && connections == 1) {
+            // large enough to be parsed on a worker thread, with names that must never show up
+            const json games = {{"Game A", make_game_data("Stale", 1000, 2000)}};
+            server.send(hdl, json::array({{{"cmd", "DataPackage"}, {"data", {{"games", games}}}}}).dump());
+            drop = true;
+        } else if (cmd == "GetDataPackage") {
+            reply.push_back(make_data_package(packageGames, command));
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+    if (drop)
+        server.close(hdl);
+}
+
+static void test_stale_frame_dropped()
+{
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "Game A", uri, "", &store};
+        ap.set_async_data_package(true);
+        connect_on_room_info(ap, error);
+
+        // the first connection is dropped while its DataPackage is parsed, the second one gets the real names
+        poll_until(ap, [&]() { return error || ap.get_item_name(1000, "Game A") == "Game A Item 0"; },
+                   std::chrono::seconds(10));
+        check(connections == 2, "connected " + std::to_string(connections) + " times, expected 2");
+        check(blockedOnReconnect, "first DataPackage was not parsed on a worker thread");
+        check(ap.get_item_name(1000, "Game A") == "Game A Item 0", "did not receive names after reconnecting");
+
+        // the stale frame finished after the reconnect and has to be dropped
+        poll_until(ap, [&]() { return false; }, std::chrono::milliseconds(100));
+        const auto name = ap.get_item_name(1000, "Game A");
+        check(name == "Game A Item 0", "stale DataPackage was applied after reconnecting: " + name);
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+}
+
+int main(int, char**)
+{
+    test_commands_before_publish();
+    test_stale_frame_dropped();
+    return failures() ? 1 : 0;
+}
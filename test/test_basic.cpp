@@ -8,74 +8,11 @@
 #define usleep(usec) std::this_thread::sleep_for(std::chrono::microseconds(usec))
 
 #ifndef EMSCRIPTEN // we can not run websocket server in wasm
-#include <websocketpp/server.hpp>
-#include <websocketpp/config/asio_no_tls.hpp>
+#include "testserver.hpp"
 
-typedef websocketpp::server<websocketpp::config::asio> Server;
-
-class TestServer final {
-public:
-    explicit TestServer(const uint16_t preferredPort, const uint16_t maxPort=0)
-        : port(preferredPort), maxPort(maxPort == 0 ? preferredPort : maxPort)
-    {
-        server.set_error_channels(websocketpp::log::elevel::fatal);
-        server.set_access_channels(websocketpp::log::alevel::none);
-        server.init_asio();
-
-        server.set_open_handler([this](const websocketpp::connection_hdl& hdl){on_open(hdl);});
-    }
-
-    ~TestServer()
-    {
-        try {
-            if (running)
-                stop();
-        } catch (...) {}
-    }
-
-    void run()
-    {
-        running = true;
-        while (true) {
-            try {
-                server.listen(port);
-                break;
-            } catch (const websocketpp::exception&) {
-                if (port == maxPort)
-                    throw;
-                port += 1;
-            }
-        }
-        server.start_accept();
-        server.run();
-    }
-
-    void stop()
-    {
-        server.stop_listening();
-        //server.stop();
-        running = false;
-    }
-
-    bool is_listening() const
-    {
-        return server.is_listening();
-    }
-
-    uint16_t get_port() const
-    {
-        return port;
-    }
-
-private:
-    Server server;
-    uint16_t port;
-    uint16_t maxPort;
-    bool running = false;
-
-    void on_open(const websocketpp::connection_hdl& hdl)
-    {
-        const std::string roomInfo = R""""(
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    const std::string roomInfo = R""""(
 [{
     "cmd": "RoomInfo",
     "seed_name": "seed_name",
@@ -87,24 +24,16 @@ private:
     "permissions": {"collect": 7}
 }]
 )"""";
-        server.send(hdl, roomInfo, websocketpp::frame::opcode::text);
-    }
-};
+    server.send(hdl, roomInfo);
+}
 #endif // ndef EMSCRIPTEN
 
 int main(int, char**)
 {
 #ifndef EMSCRIPTEN // we can not run websocket server in wasm
     printf("Starting server...\n");
-    TestServer server{38281, 38291};
-    std::thread serverThread(&TestServer::run, &server);
-    for (int i=0; i<10; i++) {
-        usleep(2000); // wait for the server to be running before starting client
-        if (server.is_listening())
-            break;
-    }
-    if (!server.is_listening())
-        throw std::runtime_error("Timeout starting server");
+    TestServer server{38281, 38291, on_open};
+    std::thread serverThread = server.start();
     printf("Server listening on %d\n", static_cast<int>(server.get_port()));
     const auto port = server.get_port();
 #else // !ndef EMSCRIPTEN
@@ -0,0 +1,145 @@
+// Tests merging and flushing of batched data storage writes, and that they are not overtaken by other commands.
+
+#include <apclient.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include "testserver.hpp"
+
+static std::mutex serverMutex;
+static json packets = json::array(); // Set commands as received, one array per packet
+static json storage = json::object();
+static json commands = json::array(); // cmd of all commands as received, with the key for Set
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    json reply = json::array();
+    json sets = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        commands.push_back(cmd == "Set" ? cmd + " " + command.value("key", "") : cmd);
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "Set") {
+            apply_set(storage, command);
+            sets.push_back(command);
+        } else if (cmd == "Get") {
+            reply.push_back(make_retrieved(storage, command));
+        }
+    }
+    if (!sets.empty())
+        packets.push_back(sets);
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+/// Get the Set commands for key in the order they were received
+static json get_sets(const std::string& key)
+{
+    json res = json::array();
+    for (const auto& packet: packets) {
+        for (const auto& command: packet) {
+            if (command["key"] == key)
+                res.push_back(command);
+        }
+    }
+    return res;
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    json retrieved;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        connect_on_room_info(ap, error);
+        ap.set_retrieved_handler([&retrieved](const std::map<std::string, json>& keys) {
+            retrieved = keys;
+        });
+        ap.set_slot_connected_handler([&ap](const json&) {
+            ap.set_data_storage_write_batching(true, 60000); // only flush explicitly
+            // consecutive adds are folded into one
+            ap.Set("add", 0, false, {{"add", 1}});
+            ap.Set("add", 0, false, {{"add", 2}});
+            // add after mul is not merged
+            ap.Set("mul", 1, false, {{"mul", 3}});
+            ap.Set("mul", 1, false, {{"add", 1}});
+            // want_reply and extras are never merged
+            ap.Set("reply", 0, false, {{"add", 1}});
+            ap.Set("reply", 0, true, {{"add", 1}});
+            ap.Set("extras", 0, false, {{"add", 1}}, {{"tag", 1}});
+            ap.Set("extras", 0, false, {{"add", 1}});
+            // no merging across a non-mergeable write to the same key
+            ap.Set("across", 0, false, {{"add", 1}});
+            ap.Set("across", 0, true, {{"add", 2}});
+            ap.Set("across", 0, false, {{"mul", 2}});
+            // writes are only merged into the last queued one, so A, B, A keeps its order
+            ap.Set("order_a", 0, false, {{"add", 1}});
+            ap.Set("order_b", 0, false, {{"add", 1}});
+            ap.Set("order_a", 0, false, {{"mul", 2}});
+            // default only applies to keys that don't exist
+            ap.Set("default", 5, false, {{"default", nullptr}});
+            ap.Set("default", 0, false, {{"add", 1}});
+            ap.Set("default", 7, false, {{"default", nullptr}});
+            // replace discards queued operations
+            ap.Set("replace", 0, false, {{"add", 1}});
+            ap.Set("replace", 0, false, {{"replace", 10}});
+            ap.Set("replace", 0, false, {{"add", 1}});
+            ap.flush_data_storage_writes();
+            // same key after a flush goes into a new packet, after the previous one
+            ap.Set("add", 0, false, {{"mul", 10}});
+            // other commands flush before they are sent
+            ap.Set("say", 0, false, {{"add", 1}});
+            ap.Say("after say");
+            // Get sees the writes made before it
+            ap.Get({"add", "mul", "reply", "extras", "across", "default", "replace"});
+        });
+        poll_until(ap, [&]() { return error || !retrieved.is_null(); });
+        printf("Stopping client...\n");
+    }
+
+    if (error || retrieved.is_null()) {
+        fprintf(stderr, "FAIL: %s\n", error ? "Error" : "Did not receive Retrieved");
+        return 1;
+    }
+
+    std::lock_guard<std::mutex> lock(serverMutex);
+    check(packets.size() == 2, "Sets were sent in " + std::to_string(packets.size()) + " packets, expected 2");
+    const json expected = {{"add", 30}, {"mul", 4}, {"reply", 2}, {"extras", 2}, {"across", 6}, {"default", 6},
+                           {"replace", 11}};
+    check(retrieved == expected, "values are " + retrieved.dump() + ", expected " + expected.dump());
+
+    auto sets = get_sets("add");
+    check(sets.size() == 2 && sets[0]["operations"] == json::parse(R"([{"operation": "add", "value": 3}])"),
+          "adds were not folded: " + sets.dump());
+    sets = get_sets("mul");
+    check(sets.size() == 1 && sets[0]["operations"].size() == 2, "add after mul was merged: " + sets.dump());
+    sets = get_sets("reply");
+    check(sets.size() == 2, "want_reply was merged: " + sets.dump());
+    sets = get_sets("extras");
+    check(sets.size() == 2 && sets[0].value("tag", 0) == 1 && !sets[1].contains("tag"),
+          "extras were merged: " + sets.dump());
+    sets = get_sets("across");
+    check(sets.size() == 3, "merged across a non-mergeable write: " + sets.dump());
+    json order = json::array();
+    for (const auto& command: packets.empty() ? json::array() : packets[0]) {
+        if (command["key"] == "order_a" || command["key"] == "order_b")
+            order.push_back(command["key"]);
+    }
+    check(order == json{"order_a", "order_b", "order_a"}, "A, B, A was reordered: " + order.dump());
+    const auto itSet = std::find(commands.begin(), commands.end(), "Set say");
+    const auto itSay = std::find(commands.begin(), commands.end(), "Say");
+    check(itSet != commands.end() && itSay != commands.end() && itSet < itSay,
+          "Say overtook a batched Set: " + commands.dump());
+    sets = get_sets("replace");
+    check(sets.size() == 1 && sets[0]["operations"] == json::parse(R"([{"operation": "replace", "value": 10},)"
+                                                                   R"( {"operation": "add", "value": 1}])"),
+          "replace did not discard operations: " + sets.dump());
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+// Tests the local data storage cache: values of Retrieved and SetReply are cached, the changed handler is only
+// called if a value changes, Sets of keys in SetNotify are applied to cached values right away and skipped if they
+// can't change them, and replies to internal probes are not cached.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "testserver.hpp"
+
+static std::mutex serverMutex;
+static json sets = json::array(); // Set commands as received
+static json storage = {{"cached", 5}, {"stale", 3}, {"_read_race_mode", 0}};
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "Get") {
+            reply.push_back(make_retrieved(storage, command));
+        } else if (cmd == "Set") {
+            const auto setReply = apply_set(storage, command);
+            sets.push_back(command);
+            if (command["want_reply"])
+                reply.push_back(setReply);
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    bool done = false;
+    bool probeSeen = false;
+    json retrieved;
+    json optimistic;
+    json stale;
+    std::vector<std::string> changes; // key=value for each call of the changed handler
+    std::vector<std::string> changesBeforeReplies;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        ap.set_data_storage_cache_enabled(true);
+        ap.set_clock_sync_interval(10);
+        connect_on_room_info(ap, error);
+        ap.set_slot_connected_handler([&ap](const json&) {
+            ap.SetNotify({"cached", "null"});
+            ap.Get({"cached", "null", "stale"});
+        });
+        ap.set_retrieved_handler([&](const std::map<std::string, json>& keys) {
+            if (keys.count("_read_race_mode"))
+                probeSeen = true;
+            if (keys.count("done")) {
+                done = true;
+                return;
+            }
+            const json* cached = ap.get_data_storage_value("cached");
+            const json* null = ap.get_data_storage_value("null");
+            retrieved = {cached ? *cached : json("not cached"), null ? *null : json("not cached")};
+            ap.Set("cached", 0, false, {{"add", 0}}); // dropped
+            ap.Set("cached", 0, true, {{"add", 0}}); // reply wanted
+            ap.Set("null", 0, false, {{"add", 0}}); // default may apply
+            ap.Set("uncached", 0, false, {{"add", 0}}); // value unknown
+            ap.Set("stale", 0, false, {{"add", 0}}); // not in SetNotify, so the value may be stale
+            ap.Set("stale", 0, false, {{"add", 1}}); // not applied locally, no SetReply would correct it
+            ap.Set("cached", 0, false, {{"mul", 1}, {"add", 0}}); // dropped
+            ap.Set("cached", 0, false, {{"add", 1}}); // changes the value
+            const json* value = ap.get_data_storage_value("cached");
+            optimistic = value ? *value : json();
+            value = ap.get_data_storage_value("stale");
+            stale = value ? *value : json();
+            changesBeforeReplies = changes;
+            ap.Get({"done"});
+        });
+        ap.set_data_storage_changed_handler([&changes](const std::string& key, const json& value) {
+            changes.push_back(key + "=" + value.dump());
+        });
+
+        check(poll_until(ap, [&]() { return error || done; }), "Timeout");
+        check(poll_until(ap, [&]() { return error || ap.get_rtt() >= 0; }), "No clock sync probe was answered");
+        if (ap.get_data_storage_value("_read_race_mode"))
+            probeSeen = true;
+        ap.set_data_storage_cache_enabled(false);
+        check(ap.get_data_storage_value("cached") == nullptr, "Cache was not cleared when disabled");
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    check(!probeSeen, "Clock sync probe reply was handled as user data");
+    check(retrieved == json{5, nullptr}, "Retrieved was not cached: " + retrieved.dump());
+    check(optimistic == 6, "Cache was not updated optimistically: " + optimistic.dump());
+    check(stale == 3, "Cache of a key that is not in SetNotify was updated: " + stale.dump());
+    std::string changeList;
+    for (const auto& change: changesBeforeReplies)
+        changeList += " " + change;
+    check(changesBeforeReplies == std::vector<std::string>{"cached=5", "null=null", "stale=3", "null=0", "cached=6"},
+          "Wrong changes:" + changeList);
+    std::lock_guard<std::mutex> lock(serverMutex);
+    json keys = json::array();
+    for (const auto& command: sets)
+        keys.push_back(command["key"]);
+    check(keys == json{"cached", "null", "uncached", "stale", "stale", "cached"} && sets[0]["want_reply"],
+          "Wrong Sets sent: " + sets.dump());
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+// Tests clock sync: the round trip time is measured with probes and the server time is corrected by half of the
+// smallest round trip time.
+
+#include <apclient.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "testserver.hpp"
+
+static const double serverStartTime = 1700000000.;
+static const int replyDelayMs = 40; ///< how long the server takes to reply to a probe
+static std::atomic<int> probes{0};
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    json roomInfo = make_room_info();
+    roomInfo["time"] = serverStartTime;
+    server.send(hdl, json::array({roomInfo}).dump());
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "Get") {
+            std::this_thread::sleep_for(std::chrono::milliseconds(replyDelayMs));
+            reply.push_back(make_retrieved({{"_read_race_mode", 0}}, command));
+            probes++;
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        std::chrono::steady_clock::time_point roomInfoTime;
+        bool connected = false;
+        ap.set_clock_sync_interval(10);
+        report_socket_errors(ap, error);
+        ap.set_room_info_handler([&ap, &roomInfoTime]() {
+            roomInfoTime = std::chrono::steady_clock::now();
+            ap.ConnectSlot("Player", "", 0b111);
+        });
+        ap.set_slot_connected_handler([&ap, &connected](const json&) {
+            connected = true;
+            check(ap.get_rtt() < 0, "rtt is known before the first probe");
+            check(ap.get_server_time_uncertainty() < 0, "uncertainty is known before the first probe");
+        });
+
+        poll_until(ap, [&]() { return error || probes >= 3; });
+        check(connected, "slot did not connect");
+        check(probes >= 3, "sent " + std::to_string(probes) + " probes, expected at least 3");
+        // wait for the reply to the last probe
+        poll_until(ap, [&]() { return error || ap.get_rtt() >= 0; });
+
+        const double delay = replyDelayMs / 1000.;
+        const double rtt = ap.get_rtt();
+        const double uncertainty = ap.get_server_time_uncertainty();
+        printf("rtt %.3f s, uncertainty %.3f s\n", rtt, uncertainty);
+        check(rtt >= delay && rtt < delay + 1, "rtt is " + std::to_string(rtt));
+        check(uncertainty >= delay / 2 && uncertainty <= rtt / 2 + .5, "uncertainty is " + std::to_string(uncertainty));
+
+        // server time is the time in RoomInfo plus the local time since then plus the latency of RoomInfo
+        const double local = std::chrono::duration<double>(std::chrono::steady_clock::now() - roomInfoTime).count();
+        const double offset = ap.get_server_time() - serverStartTime - local;
+        printf("server time offset %.3f s\n", offset);
+        check(offset >= uncertainty - .01 && offset <= uncertainty + .05,
+              "server time is off by " + std::to_string(offset) + " s, expected " + std::to_string(uncertainty));
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    return failures() ? 1 : 0;
+}
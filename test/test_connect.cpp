@@ -0,0 +1,80 @@
+// Tests connecting with and without scheme, including racing ws:// and wss:// when no scheme is given.
+
+#include <apclient.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "testserver.hpp"
+
+enum class Result {
+    CONNECTED,
+    FAILED,
+    TIMED_OUT,
+};
+
+/// Connect to uri and wait for RoomInfo or a socket error
+static Result try_connect(const std::string& uri, bool& error)
+{
+    printf("Connecting to %s...\n", uri.c_str());
+    bool roomInfo = false;
+    error = false;
+    APClient ap{"", "", uri};
+    report_socket_errors(ap, error);
+    ap.set_room_info_handler([&roomInfo]() {
+        roomInfo = true;
+    });
+    const auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        ap.poll();
+        if (roomInfo)
+            return Result::CONNECTED;
+        if (error)
+            return Result::FAILED;
+        usleep(100);
+    }
+    return Result::TIMED_OUT;
+}
+
+int main(int, char**)
+{
+    bool error;
+    Result withoutScheme, withScheme, again;
+    bool withoutSchemeError, withSchemeError, againError;
+    uint16_t port;
+    {
+        ScopedTestServer server{send_room_info};
+        port = server.server.get_port();
+        const std::string host = "localhost:" + std::to_string(port);
+
+        // the server only speaks ws://, so a race has to be won by ws:// without reporting an error
+        withoutScheme = try_connect(host, error);
+        withoutSchemeError = error;
+        withScheme = try_connect("ws://" + host, error);
+        withSchemeError = error;
+        // the remembered scheme is used for the next connect
+        again = try_connect(host, error);
+        againError = error;
+    }
+
+    // both schemes fail, this has to be reported and not wait forever.
+    // a different host, so no scheme is remembered and both are raced
+    const auto refused = try_connect("127.0.0.1:" + std::to_string(port), error);
+
+    if (withoutScheme != Result::CONNECTED || withoutSchemeError) {
+        fprintf(stderr, "FAIL: Could not connect without scheme\n");
+        return 1;
+    }
+    if (withScheme != Result::CONNECTED || withSchemeError) {
+        fprintf(stderr, "FAIL: Could not connect with ws://\n");
+        return 1;
+    }
+    if (again != Result::CONNECTED || againError) {
+        fprintf(stderr, "FAIL: Could not connect again without scheme\n");
+        return 1;
+    }
+    if (refused != Result::FAILED) {
+        fprintf(stderr, "FAIL: Connection failure was not reported\n");
+        return 1;
+    }
+    return 0;
+}
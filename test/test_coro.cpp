@@ -0,0 +1,118 @@
+// Tests the C++20 awaitables in apcoro.hpp. Built as C++20, unlike the other tests.
+
+#include <apcoro.hpp>
+#include <coroutine>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include "testserver.hpp"
+
+static json storage = {{"key", 42}};
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected({{"option", 1}}));
+        } else if (cmd == "Get") {
+            reply.push_back(make_retrieved(storage, command));
+        } else if (cmd == "Set") {
+            reply.push_back(apply_set(storage, command));
+        } else if (cmd == "LocationScouts") {
+            json locations = json::array();
+            for (const auto& location: command["locations"]) {
+                locations.push_back({{"item", 100}, {"location", location}, {"player", 1}, {"flags", 0},
+                                     {"class", "NetworkItem"}});
+            }
+            reply.push_back({{"cmd", "LocationInfo"}, {"locations", locations}});
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+/// Minimal fire-and-forget coroutine type
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+struct Results {
+    bool notConnected = false;
+    bool connected = false;
+    bool get = false;
+    bool set = false;
+    bool scout = false;
+    bool done = false;
+};
+
+static Task run(APClient& ap, Results& results)
+{
+    // GCC 12 fails to compile braced initializer lists as arguments in co_await expressions
+    const std::list<std::string> keys = {"key"};
+    const std::list<int64_t> locations = {1, 2};
+    const std::list<APClient::DataStorageOperation> operations = {{"replace", 7}};
+    // can not be sent before connecting the slot, so it completes without suspending
+    const auto early = co_await AP::get(ap, keys);
+    results.notConnected = !early.success;
+
+    const auto connected = co_await AP::connect_slot(ap, "Player", "", 0b111, {}, APCLIENTPP_VERSION_INITIALIZER,
+                                                     5000);
+    results.connected = connected.success && connected.slotData.value("option", 0) == 1;
+
+    const auto get = co_await AP::get(ap, keys, 5000);
+    results.get = get.success && get.keys.value("key", 0) == 42;
+
+    const auto set = co_await AP::set(ap, "key", 0, operations, 5000);
+    results.set = set.success && set.reply.value("value", 0) == 7;
+
+    const auto scout = co_await AP::scout(ap, locations, 0, 5000);
+    results.scout = scout.success && scout.items.size() == 2 && scout.items.front().location == 1;
+
+    results.done = true;
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    Results results;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        report_socket_errors(ap, error);
+        ap.set_room_info_handler([&ap, &results]() {
+            run(ap, results);
+        });
+        poll_until(ap, [&]() { return error || results.done; });
+        printf("Stopping client...\n");
+    }
+
+    if (error) {
+        fprintf(stderr, "FAIL: Error\n");
+        return 1;
+    }
+    if (!results.notConnected) {
+        fprintf(stderr, "FAIL: Get before connecting the slot did not fail\n");
+        return 1;
+    }
+    if (!results.done) {
+        fprintf(stderr, "FAIL: Coroutine did not finish\n");
+        return 1;
+    }
+    if (!results.connected || !results.get || !results.set || !results.scout) {
+        fprintf(stderr, "FAIL: Results: connect %d, get %d, set %d, scout %d\n", results.connected, results.get,
+                results.set, results.scout);
+        return 1;
+    }
+    return 0;
+}
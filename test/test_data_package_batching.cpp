@@ -0,0 +1,121 @@
+// Tests that GetDataPackage packs games in order into batches by their size and keeps at most the configured number
+// of requests in flight.
+
+#include <apclient.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "testserver.hpp"
+
+static const size_t batchSize = 3000;
+static const size_t maxInFlight = 2;
+/// Games with their size hints; Archipelago sorts first, Game C is over the batch size on its own
+static const std::vector<std::pair<std::string, size_t>> gameSizes = {
+    {"Archipelago", 1000}, {"Game A", 1500}, {"Game B", 2500}, {"Game C", 5000}, {"Game D", 500}, {"Game E", 500},
+    {"Game F", 2500},
+};
+
+static std::mutex serverMutex;
+static json requests = json::array(); // games of each GetDataPackage in the order received
+static std::vector<json> pending; // GetDataPackage commands without reply
+static size_t maxPending = 0;
+
+static json get_package_games()
+{
+    json packageGames = json::object();
+    int64_t base = 1000;
+    for (const auto& pair: gameSizes) {
+        packageGames[pair.first] = make_game_data(pair.first, base, 3);
+        base += 1000;
+    }
+    return packageGames;
+}
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    const json packageGames = get_package_games();
+    json games = json::array();
+    for (const auto& pair: gameSizes) {
+        if (pair.first != "Archipelago")
+            games.push_back(pair.first);
+    }
+    server.send(hdl, json::array({make_room_info(games, get_checksums(packageGames))}).dump());
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "GetDataPackage") {
+            // replies are held back until the client says something
+            requests.push_back(command["games"]);
+            pending.push_back(command);
+            maxPending = std::max(maxPending, pending.size());
+        } else if (cmd == "Say") {
+            const json packageGames = get_package_games();
+            for (const auto& request: pending)
+                reply.push_back(make_data_package(packageGames, request));
+            pending.clear();
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        MemoryDataPackageStore store;
+        for (const auto& pair: gameSizes)
+            store.set_size_hint(pair.first, pair.second);
+        APClient ap{"", "", uri, "", &store};
+        bool connected = false;
+        bool dataPackage = false;
+        ap.set_data_package_batching(batchSize, maxInFlight);
+        connect_on_room_info(ap, error);
+        ap.set_slot_connected_handler([&connected](const json&) {
+            connected = true;
+        });
+        ap.set_data_package_changed_handler([&dataPackage](const json&) {
+            dataPackage = true;
+        });
+
+        poll_until(ap, [&]() { return error || connected; });
+        check(connected, "slot did not connect");
+        {
+            std::lock_guard<std::mutex> lock(serverMutex);
+            check(requests.size() == maxInFlight, "sent " + std::to_string(requests.size()) +
+                                                  " requests before the first reply");
+        }
+        // release the replies until all games arrived
+        poll_until(ap, [&]() {
+            if (error || dataPackage)
+                return true;
+            ap.Say("reply");
+            return false;
+        });
+        check(dataPackage, "data package was not completed");
+        check(ap.get_item_name(7001, "Game F") == "Game F Item 1", "names were not loaded");
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    std::lock_guard<std::mutex> lock(serverMutex);
+    // packed in order up to the batch size, a game over the batch size gets a request of its own
+    const json expected = {{"Archipelago", "Game A"}, {"Game B"}, {"Game C"}, {"Game D", "Game E"}, {"Game F"}};
+    check(requests == expected, "requested " + requests.dump() + ", expected " + expected.dump());
+    check(maxPending == maxInFlight, std::to_string(maxPending) + " requests were in flight");
+    return failures() ? 1 : 0;
+}
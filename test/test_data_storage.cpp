@@ -0,0 +1,240 @@
+// Tests the local evaluator of data storage operations against the results of the server.
+
+#include <apclient.hpp>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using json = nlohmann::json;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static json apply(const json& value, const std::string& operation, const json& arg)
+{
+    return APClient::apply_data_storage_operations(value, nullptr, {{operation, arg}});
+}
+
+static void check_int(const json& value, const std::string& operation, const json& arg, int64_t expected)
+{
+    const auto res = apply(value, operation, arg);
+    check(res.is_number_integer() && res.get<int64_t>() == expected,
+          value.dump() + " " + operation + " " + arg.dump() + " = " + res.dump() + ", expected " +
+          std::to_string(expected));
+}
+
+static void check_float(const json& value, const std::string& operation, const json& arg, double expected)
+{
+    const auto res = apply(value, operation, arg);
+    check(res.is_number_float() && (res.get<double>() == expected ||
+                                    (std::isnan(expected) && std::isnan(res.get<double>()))),
+          value.dump() + " " + operation + " " + arg.dump() + " = " + res.dump() + ", expected float " +
+          std::to_string(expected));
+}
+
+static void check_json(const json& value, const std::string& operation, const json& arg, const json& expected)
+{
+    const auto res = apply(value, operation, arg);
+    check(res == expected && res.type() == expected.type(),
+          value.dump() + " " + operation + " " + arg.dump() + " = " + res.dump() + ", expected " + expected.dump());
+}
+
+static void check_throws(const json& value, const std::string& operation, const json& arg)
+{
+    try {
+        apply(value, operation, arg);
+        check(false, value.dump() + " " + operation + " " + arg.dump() + " did not throw");
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+static void test_pow()
+{
+    const int64_t hugeExp = 9000000000000000000;
+    // must not loop exp times
+    check_int(0, "pow", hugeExp, 0);
+    check_int(1, "pow", hugeExp, 1);
+    check_int(-1, "pow", hugeExp, 1);
+    check_int(-1, "pow", hugeExp + 1, -1);
+    check_float(1, "pow", 9e18, 1.);
+    check_int(0, "pow", 0, 1);
+    check_int(5, "pow", 0, 1);
+    check_int(2, "pow", 10, 1024);
+    check_int(-3, "pow", 3, -27);
+    check_int(2, "pow", 62, int64_t(1) << 62);
+    // overflow falls back to float
+    check_float(3, "pow", 40, std::pow(3., 40.));
+    check_float(2, "pow", hugeExp, std::pow(2., static_cast<double>(hugeExp)));
+    check_float(2, "pow", -1, 0.5);
+    check_float(2.5, "pow", 2, 6.25);
+    check_throws("a", "pow", 2);
+}
+
+static void test_mod()
+{
+    // sign follows the divisor
+    check_int(7, "mod", 3, 1);
+    check_int(7, "mod", -3, -2);
+    check_int(-7, "mod", 3, 2);
+    check_int(-7, "mod", -3, -1);
+    check_int(std::numeric_limits<int64_t>::min(), "mod", -1, 0);
+    check_float(7.5, "mod", 2, 1.5);
+    check_float(-7.5, "mod", 2, 0.5);
+    check_throws(7, "mod", 0);
+    check_throws(7.5, "mod", 0.);
+}
+
+static void test_floor_ceil()
+{
+    check_int(1.5, "floor", nullptr, 1);
+    check_int(-1.5, "floor", nullptr, -2);
+    check_int(1.5, "ceil", nullptr, 2);
+    check_int(-1.5, "ceil", nullptr, -1);
+    check_int(42, "floor", nullptr, 42);
+    // out of range of int64 keeps the float
+    check_float(1e300, "floor", nullptr, 1e300);
+    check_float(-1e300, "ceil", nullptr, -1e300);
+    check_float(std::numeric_limits<double>::infinity(), "floor", nullptr, std::numeric_limits<double>::infinity());
+    check_float(std::numeric_limits<double>::quiet_NaN(), "ceil", nullptr, std::numeric_limits<double>::quiet_NaN());
+    check_throws("a", "floor", nullptr);
+}
+
+static void test_min_max()
+{
+    check_int(3, "max", 5, 5);
+    check_int(5, "max", 3, 5);
+    check_int(3, "min", 5, 3);
+    check_float(3, "min", 2.5, 2.5);
+    check_int(3, "max", 2.5, 3);
+    check_int(std::numeric_limits<int64_t>::max(), "max", std::numeric_limits<int64_t>::max() - 1,
+              std::numeric_limits<int64_t>::max());
+    check_throws("a", "max", 1);
+    check_throws(1, "min", "a");
+}
+
+static void test_add()
+{
+    check_int(1, "add", 2, 3);
+    check_int(1, "add", -2, -1);
+    check_float(1, "add", 0.5, 1.5);
+    check_float(0.5, "add", 1, 1.5);
+    // overflow falls back to float
+    check_float(std::numeric_limits<int64_t>::max(), "add", 1,
+                static_cast<double>(std::numeric_limits<int64_t>::max()) + 1.);
+    check_float(std::numeric_limits<int64_t>::min(), "add", -1,
+                static_cast<double>(std::numeric_limits<int64_t>::min()) - 1.);
+    check_json(json::array({1, 2}), "add", json::array({2, 3}), json::array({1, 2, 2, 3}));
+    check_json(json::array(), "add", json::array(), json::array());
+    check_json("ab", "add", "cd", "abcd");
+    check_throws(json::array({1}), "add", 1);
+    check_throws(1, "add", json::array({1}));
+    check_throws("a", "add", 1);
+    check_throws(json::object(), "add", json::object());
+    check_throws(nullptr, "add", 1);
+}
+
+static void test_remove()
+{
+    check_json(json::array({1, 2, 1}), "remove", 1, json::array({2, 1})); // only the first match
+    check_json(json::array({1, 2}), "remove", 3, json::array({1, 2}));
+    check_json(json::array({1, "1"}), "remove", "1", json::array({1}));
+    check_throws(json::object({{"1", 1}}), "remove", "1");
+    check_throws(1, "remove", 1);
+}
+
+static void test_pop()
+{
+    check_json(json::array({1, 2, 3}), "pop", 0, json::array({2, 3}));
+    check_json(json::array({1, 2, 3}), "pop", -1, json::array({1, 2}));
+    check_json(json::array({1, 2, 3}), "pop", 3, json::array({1, 2, 3}));
+    check_json(json::array({1, 2, 3}), "pop", -4, json::array({1, 2, 3}));
+    check_json(json::object({{"a", 1}, {"b", 2}}), "pop", "a", json::object({{"b", 2}}));
+    check_json(json::object({{"a", 1}}), "pop", "c", json::object({{"a", 1}}));
+    check_throws(json::array({1}), "pop", "0");
+    check_throws(json::array({1}), "pop", 0.5);
+    check_throws(json::object({{"0", 1}}), "pop", 0);
+    check_throws("abc", "pop", 0);
+}
+
+static void test_update()
+{
+    check_json(json::object({{"a", 1}, {"b", 2}}), "update", json::object({{"b", 3}, {"c", 4}}),
+               json::object({{"a", 1}, {"b", 3}, {"c", 4}}));
+    // arrays are treated as sets, existing entries are kept in order
+    check_json(json::array({1, 2}), "update", json::array({2, 3, 3}), json::array({1, 2, 3}));
+    check_throws(json::object(), "update", json::array());
+    check_throws(json::array(), "update", json::object());
+    check_throws(1, "update", json::object());
+}
+
+static void test_shift()
+{
+    check_int(1, "left_shift", 3, 8);
+    check_int(-1, "left_shift", 3, -8);
+    check_int(0, "left_shift", 100, 0);
+    check_int(8, "right_shift", 3, 1);
+    check_int(-8, "right_shift", 1, -4);
+    check_int(1, "right_shift", 100, 0);
+    check_int(-1, "right_shift", 100, -1);
+    // overflow falls back to float
+    check_float(1, "left_shift", 63, std::ldexp(1., 63));
+    check_float(3, "left_shift", 62, std::ldexp(3., 62));
+    check_throws(1, "left_shift", -1);
+    check_throws(1, "right_shift", -1);
+    check_throws(1.5, "left_shift", 1);
+    check_throws(1, "right_shift", 1.5);
+}
+
+static void test_bitwise()
+{
+    check_int(6, "and", 3, 2);
+    check_int(6, "or", 3, 7);
+    check_int(6, "xor", 3, 5);
+    check_int(-1, "and", 5, 5);
+    check_throws(6.5, "and", 3);
+    check_throws(6, "or", 3.5);
+    check_throws("6", "xor", 3);
+    check_throws(json::array(), "and", 1);
+}
+
+static void test_replace_default()
+{
+    check_json(1, "replace", "a", "a");
+    check_json(json::array({1}), "replace", json::object(), json::object());
+    check_json(1, "replace", nullptr, nullptr);
+    check_int(1, "default", 2, 1);
+    check_json(json::array({1}), "default", json::array(), json::array({1}));
+    // default is used for keys that don't exist
+    auto res = APClient::apply_data_storage_operations(nullptr, 5, {{"default", 0}});
+    check(res == 5, "null default 0 with dflt 5 = " + res.dump());
+    res = APClient::apply_data_storage_operations(nullptr, 5, {{"add", 1}, {"mul", 2}});
+    check(res == 12, "null add 1 mul 2 with dflt 5 = " + res.dump());
+    res = APClient::apply_data_storage_operations(3, 5, {{"replace", nullptr}, {"default", 0}});
+    check(res.is_null(), "3 replace null default 0 = " + res.dump());
+    check_throws(1, "unknown", 1);
+}
+
+int main(int, char**)
+{
+    test_add();
+    test_remove();
+    test_pop();
+    test_update();
+    test_shift();
+    test_bitwise();
+    test_replace_default();
+    test_pow();
+    test_mod();
+    test_floor_ceil();
+    test_min_max();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+// Tests the message history: lookup by id, filtered lookups through the indexes and trimming to the budget.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+#include "testserver.hpp"
+
+static const int messageCount = 30;
+
+/// What message i is about. Every message ends with "#i" when rendered.
+struct Expected {
+    std::string type;
+    std::set<int> players;
+    std::set<int64_t> items;
+    std::string marker;
+};
+
+static Expected get_expected(int i)
+{
+    Expected res;
+    res.marker = "#" + std::to_string(i);
+    if (i % 3 == 0) {
+        res.type = "ItemSend";
+        res.players = {1 + i % 4, 1 + (i + 1) % 4};
+        res.items = {100 + i % 5};
+    } else if (i % 3 == 1) {
+        res.type = "Chat";
+        res.players = {1 + i % 4};
+    }
+    return res;
+}
+
+static json make_message(int i)
+{
+    const auto marker = "#" + std::to_string(i);
+    if (i % 3 == 0) {
+        const int sender = 1 + i % 4;
+        const int receiver = 1 + (i + 1) % 4;
+        const int64_t item = 100 + i % 5;
+        return {
+            {"cmd", "PrintJSON"},
+            {"type", "ItemSend"},
+            {"receiving", receiver},
+            {"item", {{"item", item}, {"location", 1000 + i}, {"player", sender}, {"flags", 0},
+                      {"class", "NetworkItem"}}},
+            {"data", {
+                {{"type", "player_id"}, {"text", std::to_string(sender)}},
+                {{"text", " sent "}},
+                {{"type", "item_id"}, {"text", std::to_string(item)}, {"player", receiver}, {"flags", 0}},
+                {{"text", " to "}},
+                {{"type", "player_id"}, {"text", std::to_string(receiver)}},
+                {{"text", " " + marker}},
+            }},
+        };
+    } else if (i % 3 == 1) {
+        return {
+            {"cmd", "PrintJSON"},
+            {"type", "Chat"},
+            {"slot", 1 + i % 4},
+            {"team", 0},
+            {"message", "chat"},
+            {"data", {
+                {{"type", "player_id"}, {"text", "not a number"}}, // not indexed
+                {{"text", "chat " + marker}},
+            }},
+        };
+    }
+    return {{"cmd", "Print"}, {"text", "print " + marker}};
+}
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    json packet = json::array();
+    packet.push_back(make_room_info());
+    for (int i = 0; i < messageCount; i++)
+        packet.push_back(make_message(i));
+    server.send(hdl, packet.dump());
+}
+
+static std::string to_string(const std::vector<uint64_t>& ids)
+{
+    std::string s;
+    for (auto id: ids)
+        s += " " + std::to_string(id);
+    return s;
+}
+
+/// Compare find_message_history to what is expected for the stored messages; firstId is the id of message 0
+static void check_filters(const APClient& ap, uint64_t firstId)
+{
+    std::vector<APClient::HistoryFilter> filters;
+    for (int player = 0; player <= 5; player++) {
+        APClient::HistoryFilter filter;
+        filter.player = player;
+        filters.push_back(filter);
+        filter.type = "ItemSend";
+        filters.push_back(filter);
+        filter.item = 100 + player % 5;
+        filters.push_back(filter);
+    }
+    for (int64_t item = 99; item <= 105; item++) {
+        APClient::HistoryFilter filter;
+        filter.item = item;
+        filters.push_back(filter);
+    }
+    for (const char* type: {"ItemSend", "Chat", "Hint"}) {
+        APClient::HistoryFilter filter;
+        filter.type = type;
+        filters.push_back(filter);
+    }
+    filters.emplace_back(); // matches everything
+
+    const auto stored = ap.get_message_history();
+    for (const auto& filter: filters) {
+        std::vector<uint64_t> expected;
+        for (auto id: stored) {
+            const auto e = get_expected(static_cast<int>(id - firstId));
+            if ((filter.player < 0 || e.players.count(filter.player)) &&
+                    (filter.item == APClient::INVALID_NAME_ID || e.items.count(filter.item)) &&
+                    (filter.type.empty() || e.type == filter.type))
+                expected.push_back(id);
+        }
+        const std::string what = "filter player " + std::to_string(filter.player) + " item " +
+                                 std::to_string(filter.item) + " type \"" + filter.type + "\"";
+        const auto found = ap.find_message_history(filter);
+        check(found == expected, what + " found" + to_string(found) + ", expected" + to_string(expected));
+        // limit returns the newest
+        const auto limited = ap.find_message_history(filter, 2);
+        if (expected.size() > 2)
+            expected.erase(expected.begin(), expected.end() - 2);
+        check(limited == expected, what + " limit 2 found" + to_string(limited) + ", expected" +
+                                   to_string(expected));
+    }
+}
+
+/// Check that ids are consecutive, end with the last message and resolve to the right messages
+static void check_entries(APClient& ap, uint64_t firstId, const std::string& what)
+{
+    const auto ids = ap.get_message_history();
+    check(!ids.empty() && ids.back() == firstId + messageCount - 1, what + ": newest message missing");
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i > 0)
+            check(ids[i] == ids[i - 1] + 1, what + ": ids not consecutive:" + to_string(ids));
+        const auto entry = ap.get_message_history_entry(ids[i]);
+        check(entry && entry->id == ids[i], what + ": wrong entry for id " + std::to_string(ids[i]));
+        const auto marker = get_expected(static_cast<int>(ids[i] - firstId)).marker;
+        const auto text = ap.render_message_history_entry(ids[i]);
+        check(text.size() >= marker.size() && text.compare(text.size() - marker.size(), marker.size(), marker) == 0,
+              what + ": message " + std::to_string(ids[i]) + " is \"" + text + "\", expected " + marker);
+    }
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{on_open};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        ap.set_message_history_budget(1 << 20);
+        report_socket_errors(ap, error);
+        poll_until(ap, [&]() { return error || ap.get_message_history().size() == messageCount; });
+
+        const auto ids = ap.get_message_history();
+        check(error || ids.size() == messageCount, "received " + std::to_string(ids.size()) + " messages, expected " +
+                                                   std::to_string(messageCount));
+        if (!error && ids.size() == messageCount) {
+            const uint64_t firstId = ids.front();
+            check_entries(ap, firstId, "all");
+            check_filters(ap, firstId);
+
+            // trimming drops the oldest and keeps the indexes consistent
+            const size_t budget = ap.get_message_history_memory() / 2;
+            ap.set_message_history_budget(budget);
+            const auto trimmed = ap.get_message_history();
+            check(ap.get_message_history_memory() <= budget, "memory is over budget after trimming");
+            check(!trimmed.empty() && trimmed.size() < ids.size(),
+                  "trimmed to " + std::to_string(trimmed.size()) + " messages");
+            check(!ap.get_message_history_entry(firstId), "oldest message still exists");
+            check(ap.render_message_history_entry(firstId).empty(), "oldest message still renders");
+            check_entries(ap, firstId, "trimmed");
+            check_filters(ap, firstId);
+
+            // rendering uses memory and trims older messages, but not the one being rendered
+            const auto before = ap.get_message_history();
+            const uint64_t itemSend = firstId + 27; // long enough to need memory when rendered
+            ap.set_message_history_budget(ap.get_message_history_memory());
+            const auto html = ap.render_message_history_entry(itemSend, APClient::RenderFormat::HTML);
+            check(!html.empty() && ap.get_message_history_entry(itemSend), "rendered message was dropped");
+            check(ap.get_message_history().size() < before.size(), "rendering did not trim older messages");
+            check(ap.get_message_history_memory() <= ap.get_message_history_budget(),
+                  "memory is over budget after rendering");
+            check_filters(ap, firstId);
+
+            ap.set_message_history_budget(0);
+            check(ap.get_message_history().empty() && ap.get_message_history_memory() == 0,
+                  "budget 0 did not clear the history");
+            check_filters(ap, firstId);
+        }
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+// Tests the lazy data package: the own game is loaded right away, other games are loaded from the store or requested
+// from the server on the first lookup of one of their names, and lookups by global id only load every game if that
+// was enabled.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include "testserver.hpp"
+
+static const json slotGames = {"Game A", "Game B", "Game C"};
+static const json packageGames = {
+    {"Archipelago", make_game_data("Archipelago", -10, 5)},
+    {"Game A", make_game_data("Game A", 1000, 3)},
+    {"Game B", make_game_data("Game B", 2000, 3)},
+    {"Game C", make_game_data("Game C", 3000, 3)}, // only on the server
+};
+
+static std::mutex serverMutex;
+static json requested = json::array(); // games of all GetDataPackage requests
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    server.send(hdl, json::array({make_room_info(slotGames, get_checksums(packageGames))}).dump());
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected_for(slotGames));
+        } else if (cmd == "GetDataPackage") {
+            for (const auto& game: command["games"])
+                requested.push_back(game);
+            reply.push_back(make_data_package(packageGames, command));
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+static json get_requested()
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    return requested;
+}
+
+/// Store with everything but Game C
+static void fill_store(MemoryDataPackageStore& store)
+{
+    for (const auto& pair: packageGames.items()) {
+        if (pair.key() != "Game C")
+            store.save(pair.key(), pair.value());
+    }
+}
+
+/// Connect a lazy client and run test with it. Returns false on error.
+template <class F>
+static bool with_lazy_client(const std::string& uri, bool loadAllForGlobalIds, F test)
+{
+    MemoryDataPackageStore store;
+    fill_store(store);
+    APClient ap{"", "Game A", uri, "", &store};
+    bool error = false;
+    bool connected = false;
+    ap.set_lazy_data_package(true, loadAllForGlobalIds);
+    connect_on_room_info(ap, error);
+    ap.set_slot_connected_handler([&connected](const json&) {
+        connected = true;
+    });
+    poll_until(ap, [&]() { return error || connected; });
+    check(connected, "slot did not connect");
+    if (connected && !error)
+        test(ap, store);
+    printf("Stopping client...\n");
+    return !error;
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    printf("Starting client for %s...\n", uri.c_str());
+    bool ok = with_lazy_client(uri, false, [](APClient& ap, MemoryDataPackageStore& store) {
+        std::set<std::string> loaded;
+        ap.set_game_names_loaded_handler([&loaded](const std::string& game) {
+            loaded.insert(game);
+        });
+        // only the own game is loaded before a lookup, so lookups by name work right away
+        check(store.get_loads() == 1 && get_requested().empty(), "games other than Game A were loaded");
+        check(ap.get_item_id("Game A Item 1") == 1001, "item id of the own game did not resolve");
+        check(ap.get_location_id("Game A Location 2") == 1002, "location id of the own game did not resolve");
+
+        // a global id does not load the remaining games by default
+        check(ap.get_item_name(2000, "") == "Unknown", "global id of a lazy game resolved");
+        poll_until(ap, [&]() { return false; }, std::chrono::milliseconds(100));
+        check(store.get_loads() == 1 && loaded.empty(), "global id loaded lazy games");
+
+        // first lookup misses and loads that game and Archipelago, the fallback, from the store
+        check(ap.get_item_name(2001, "Game B") == "Unknown", "lazy game resolved before loading");
+        poll_until(ap, [&]() { return loaded.size() >= 2; });
+        check(loaded == std::set<std::string>{"Archipelago", "Game B"}, "loaded games other than Game B");
+        check(store.get_loads() == 3 && get_requested().empty(), "Game B was not loaded from the store alone");
+        check(ap.get_item_name(2001, "Game B") == "Game B Item 1", "Game B did not resolve after loading");
+
+        // a game that is not in the store is requested from the server
+        check(ap.get_location_name(3002, ap.get_player_game(3)) == "Unknown", "Game C resolved before loading");
+        poll_until(ap, [&]() { return loaded.size() >= 3; });
+        check(loaded.count("Game C") && !loaded.count("Game A"), "Game C was not loaded alone");
+        check(get_requested() == json{"Game C"}, "requested " + get_requested().dump() + ", expected Game C");
+        check(ap.get_location_name(3002, "Game C") == "Game C Location 2", "Game C did not resolve after loading");
+    });
+
+    // with loadAllForGlobalIds, a global id loads every game that is not loaded yet
+    ok = with_lazy_client(uri, true, [](APClient& ap, MemoryDataPackageStore&) {
+        std::set<std::string> loaded;
+        ap.set_game_names_loaded_handler([&loaded](const std::string& game) {
+            loaded.insert(game);
+        });
+        check(ap.get_item_name(2000, "") == "Unknown", "global id resolved before loading");
+        poll_until(ap, [&]() { return loaded.size() == 3; });
+        check(loaded == std::set<std::string>{"Archipelago", "Game B", "Game C"},
+              "global id did not load all lazy games");
+        check(ap.get_item_name(2000, "") == "Game B Item 0", "global id did not resolve after loading");
+    }) && ok;
+
+    check(ok, "Error");
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+// Tests the liveness timeout: a server that answers probes keeps the connection, a silent one gets probed, dropped
+// after the timeout and reconnected right away.
+
+#include <apclient.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "testserver.hpp"
+
+static const unsigned long livenessTimeout = 400;
+static std::atomic<bool> silent{false};
+static std::atomic<int> silentProbes{0}; ///< probes received while silent
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "Get") {
+            if (silent)
+                silentProbes++;
+            else
+                reply.push_back(make_retrieved(json::object(), command));
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        int connects = 0;
+        int slotConnects = 0;
+        bool disconnected = false;
+        std::chrono::steady_clock::time_point silentTime;
+        std::chrono::steady_clock::time_point disconnectTime;
+        ap.set_liveness_timeout(livenessTimeout);
+        connect_on_room_info(ap, error);
+        ap.set_socket_connected_handler([&connects]() {
+            connects++;
+        });
+        ap.set_socket_disconnected_handler([&disconnected, &disconnectTime]() {
+            disconnected = true;
+            disconnectTime = std::chrono::steady_clock::now();
+        });
+        ap.set_slot_connected_handler([&slotConnects](const json&) {
+            slotConnects++;
+        });
+
+        // replies to probes keep the connection alive for several timeouts
+        poll_until(ap, [&]() { return error || slotConnects == 1; });
+        check(slotConnects == 1, "slot did not connect");
+        poll_until(ap, [&]() { return error || disconnected; }, std::chrono::milliseconds(3 * livenessTimeout));
+        check(!disconnected, "connection was dropped while the server replied");
+
+        // a silent server is probed and the connection is dropped after the timeout
+        silent = true;
+        silentTime = std::chrono::steady_clock::now();
+        poll_until(ap, [&]() { return error || disconnected; });
+        check(disconnected, "connection to a silent server was not dropped");
+        check(silentProbes > 0, "silent server was not probed");
+        const auto detect = std::chrono::duration_cast<std::chrono::milliseconds>(disconnectTime - silentTime);
+        printf("Dropped after %d ms\n", static_cast<int>(detect.count()));
+        check(!disconnected || detect.count() <= static_cast<long long>(2 * livenessTimeout),
+              "dead connection detected after " + std::to_string(detect.count()) + " ms");
+
+        // and reconnected without waiting for the reconnect delay
+        silent = false;
+        poll_until(ap, [&]() { return error || slotConnects == 2; });
+        check(connects == 2 && slotConnects == 2, "did not reconnect");
+        const auto reconnect = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - disconnectTime);
+        printf("Reconnected after %d ms\n", static_cast<int>(reconnect.count()));
+        check(reconnect.count() < static_cast<long long>(APClient::ReconnectPolicy().initialDelay),
+              "reconnected after " + std::to_string(reconnect.count()) + " ms, not right away");
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    return failures() ? 1 : 0;
+}
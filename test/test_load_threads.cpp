@@ -0,0 +1,101 @@
+// Tests that loading cached data packages on multiple threads gives the same names as loading on one thread.
+
+#include <apclient.hpp>
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include "testserver.hpp"
+
+static const int gameCount = 12;
+static const int namesPerGame = 50;
+
+static std::atomic<int> requests{0}; ///< GetDataPackage requests, there should be none
+
+static json get_package_games()
+{
+    json packageGames = {{"Archipelago", make_game_data("Archipelago", -10, 5)}};
+    for (int i = 0; i < gameCount; i++) {
+        const std::string game = "Game " + std::to_string(i);
+        packageGames[game] = make_game_data(game, 1000 * (i + 1), namesPerGame);
+    }
+    return packageGames;
+}
+
+static json get_slot_games()
+{
+    json games = json::array();
+    for (int i = 0; i < gameCount; i++)
+        games.push_back("Game " + std::to_string(i));
+    return games;
+}
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    server.send(hdl, json::array({make_room_info(get_slot_games(), get_checksums(get_package_games()))}).dump());
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected_for(get_slot_games()));
+        } else if (cmd == "GetDataPackage") {
+            requests++;
+            reply.push_back(make_data_package(get_package_games(), command));
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+/// Connect with the given number of load threads and return all names, one per line
+static std::string load_names(const std::string& uri, unsigned threads)
+{
+    MemoryDataPackageStore store;
+    const json packageGames = get_package_games();
+    for (const auto& pair: packageGames.items())
+        store.save(pair.key(), pair.value());
+
+    APClient ap{"", "Game 0", uri, "", &store};
+    bool error = false;
+    bool connected = false;
+    ap.set_data_package_load_threads(threads);
+    connect_on_room_info(ap, error);
+    ap.set_slot_connected_handler([&connected](const json&) {
+        connected = true;
+    });
+    poll_until(ap, [&]() { return error || connected; });
+    check(!error && connected, std::to_string(threads) + " threads: slot did not connect");
+    check(ap.get_data_package_load_threads() == threads, "wrong number of load threads");
+
+    std::string names;
+    for (int i = 0; i < gameCount; i++) {
+        const int player = i + 1;
+        for (int64_t id = 1000 * player; id < 1000 * player + namesPerGame; id++) {
+            names += ap.get_item_name(id, ap.get_player_game(player)) + "\n";
+            names += ap.get_location_name(id, ap.get_player_game_id(player)) + "\n";
+            names += ap.get_item_name(id, "") + "\n"; // global ids
+        }
+    }
+    names += ap.get_item_name(-9, "Game 3") + "\n";
+    return names;
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    printf("Starting clients for %s...\n", uri.c_str());
+    const std::string expected = load_names(uri, 1);
+    check(expected.find("Unknown") == std::string::npos, "names were not loaded from the store");
+    check(expected.find("Game 11 Location 49\n") != std::string::npos, "names of the last game are missing");
+    for (unsigned threads: {2u, 3u, 8u, 0u}) {
+        const std::string names = load_names(uri, threads);
+        check(names == expected, std::to_string(threads) + " threads loaded different names");
+    }
+    check(requests == 0, "requested data packages that were in the store");
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+// Tests APClientManager: sessions are pinned to one worker thread each, tasks of a session run in order, and an
+// exception in one session's task is reported to the log handler without affecting the worker or other sessions.
+// Also tests that SharedDataPackageStore keeps a bounded number of data packages and forwards size hints.
+
+#include <apclient.hpp>
+#include <apclientmanager.hpp>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "testserver.hpp"
+
+static const size_t sessionCount = 4;
+static const size_t workerCount = 2;
+static const int taskCount = 10;
+
+/// Store that counts loads and has a size hint for every game
+class CountingStore : public APDataPackageStore {
+public:
+    bool load(const std::string& game, const std::string& checksum, json& data) override
+    {
+        loads++;
+        data = {{"checksum", checksum}, {"game", game}};
+        return true;
+    }
+
+    bool save(const std::string&, const json&) override
+    {
+        return true;
+    }
+
+    size_t get_size_hint(const std::string& game) override
+    {
+        return game.size();
+    }
+
+    int loads = 0;
+};
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        if (command.value("cmd", "") == "Connect")
+            reply.push_back(make_connected());
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+/// What happened in a session, guarded by stateMutex
+struct SessionState {
+    std::set<std::thread::id> threads; ///< threads that ran callbacks of the session
+    bool connected = false;
+    std::vector<int> tasks; ///< posted tasks in the order they ran
+};
+
+static std::mutex stateMutex;
+static std::vector<SessionState> states(sessionCount);
+static std::vector<std::pair<APClientManager::SessionId, std::string>> errors;
+static size_t logMessages = 0;
+
+static void record(APClientManager::SessionId id)
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    states[id].threads.insert(std::this_thread::get_id());
+}
+
+/// Wait until done() returns true while holding stateMutex. Returns false on timeout.
+template <class Done>
+static bool wait_for(Done done)
+{
+    const auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (done())
+                return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    {
+        APClientManager manager{workerCount, 5};
+        check(manager.get_worker_count() == workerCount, "wrong number of workers");
+        manager.set_log_handler([](APClientManager::SessionId id, bool error, const std::string& msg) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (error)
+                errors.emplace_back(id, msg);
+            else
+                logMessages++;
+        });
+
+        printf("Starting sessions for %s...\n", uri.c_str());
+        for (size_t i = 0; i < sessionCount; i++) {
+            const auto id = manager.add_session("", "", uri, [i](APClient& ap) {
+                record(i);
+                ap.set_room_info_handler([&ap, i]() {
+                    record(i);
+                    ap.ConnectSlot("Player", "", 0b111);
+                });
+                ap.set_slot_connected_handler([i](const json&) {
+                    record(i);
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    states[i].connected = true;
+                });
+            });
+            check(id == i, "session " + std::to_string(i) + " got id " + std::to_string(id));
+        }
+        check(manager.size() == sessionCount, "wrong number of sessions");
+
+        // a failing task is reported, but the session and its worker keep running
+        manager.post(1, [](APClient&) {
+            throw std::runtime_error("task failed");
+        });
+        for (size_t i = 0; i < sessionCount; i++) {
+            for (int task = 0; task < taskCount; task++) {
+                manager.post(i, [i, task](APClient&) {
+                    record(i);
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    states[i].tasks.push_back(task);
+                });
+            }
+        }
+
+        const bool done = wait_for([]() {
+            for (const auto& state: states) {
+                if (!state.connected || state.tasks.size() < static_cast<size_t>(taskCount))
+                    return false;
+            }
+            return true;
+        });
+        check(done, "sessions did not connect or run their tasks");
+        printf("Stopping sessions...\n");
+    }
+
+    std::vector<int> expectedTasks;
+    for (int task = 0; task < taskCount; task++)
+        expectedTasks.push_back(task);
+    for (size_t i = 0; i < sessionCount; i++) {
+        const auto& state = states[i];
+        const std::string session = "session " + std::to_string(i);
+        check(state.threads.size() == 1, session + " ran on " + std::to_string(state.threads.size()) + " threads");
+        check(state.tasks == expectedTasks, session + " ran tasks out of order");
+        // sessions are spread over the workers by id
+        if (i >= workerCount)
+            check(state.threads == states[i - workerCount].threads, session + " is not on the same worker as " +
+                                                                    std::to_string(i - workerCount));
+    }
+    check(states[0].threads != states[1].threads, "sessions 0 and 1 share a worker");
+    check(errors.size() == 1 && errors[0].first == 1 && errors[0].second == "task failed",
+          "exception was not reported once for session 1");
+    check(logMessages > 0, "session log messages were not passed to the log handler");
+
+    CountingStore counting;
+    SharedDataPackageStore shared{&counting, 2};
+    json data;
+    check(shared.get_size_hint("Game") == 4, "size hint was not forwarded");
+    shared.load("A", "a", data);
+    shared.load("B", "b", data);
+    shared.load("A", "a", data); // kept, A is now the most recently used
+    check(counting.loads == 2, "data package was not kept in memory");
+    shared.load("C", "c", data); // drops B
+    shared.load("A", "a", data);
+    check(counting.loads == 3, "most recently used data package was dropped");
+    shared.load("B", "b", data);
+    check(counting.loads == 4, "more data packages than the limit were kept");
+    shared.set_max_games(0);
+    shared.load("B", "b", data);
+    check(counting.loads == 5, "data package was kept with a limit of 0");
+
+    return failures() ? 1 : 0;
+}
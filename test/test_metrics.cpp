@@ -0,0 +1,229 @@
+// Tests runtime metrics: the OpenMetrics exposition of a new client byte by byte, including canonical le labels like
+// le="1.0", and that traffic counters, commands, histograms, queue depths and reconnects change with traffic.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "testserver.hpp"
+
+static std::mutex serverMutex;
+static uint64_t framesToClient = 0;
+static uint64_t bytesToClient = 0;
+static uint64_t bytesFromClient = 0;
+
+static void send_counted(TestServer& server, const websocketpp::connection_hdl& hdl, const json& packet)
+{
+    const auto frame = packet.dump();
+    framesToClient++;
+    bytesToClient += frame.size();
+    server.send(hdl, frame);
+}
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    send_counted(server, hdl, json::array({make_room_info()}));
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    bytesFromClient += message.size();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            // a command the client does not know is counted as "other"
+            send_counted(server, hdl, json::array({make_connected(), {{"cmd", "FutureCommand"}}}));
+        } else if (cmd == "Say") {
+            server.close(hdl);
+        }
+    }
+}
+
+static bool has_line(const std::string& exposition, const std::string& line)
+{
+    return exposition.find("\n" + line + "\n") != std::string::npos;
+}
+
+static void test_new_client()
+{
+    APClient ap{"", "", ""};
+    const std::string expected =
+            "# TYPE apclient_sent_bytes counter\n"
+            "# HELP apclient_sent_bytes Bytes sent.\n"
+            "apclient_sent_bytes_total 0\n"
+            "# TYPE apclient_received_bytes counter\n"
+            "# HELP apclient_received_bytes Bytes received.\n"
+            "apclient_received_bytes_total 0\n"
+            "# TYPE apclient_sent_frames counter\n"
+            "# HELP apclient_sent_frames Websocket frames sent.\n"
+            "apclient_sent_frames_total 0\n"
+            "# TYPE apclient_received_frames counter\n"
+            "# HELP apclient_received_frames Websocket frames received.\n"
+            "apclient_received_frames_total 0\n"
+            "# TYPE apclient_sent_commands counter\n"
+            "# HELP apclient_sent_commands Commands sent by cmd.\n"
+            "# TYPE apclient_received_commands counter\n"
+            "# HELP apclient_received_commands Commands received by cmd.\n"
+            "# TYPE apclient_parse_seconds histogram\n"
+            "# HELP apclient_parse_seconds Time spent parsing received frames.\n"
+            "apclient_parse_seconds_bucket{le=\"0.0001\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"0.0005\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"0.001\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"0.005\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"0.01\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"0.05\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"0.1\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"0.5\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"1.0\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"5.0\"} 0\n"
+            "apclient_parse_seconds_bucket{le=\"+Inf\"} 0\n"
+            "apclient_parse_seconds_sum 0\n"
+            "apclient_parse_seconds_count 0\n"
+            "# TYPE apclient_validation_seconds histogram\n"
+            "# HELP apclient_validation_seconds Time spent validating received frames.\n"
+            "apclient_validation_seconds_bucket{le=\"0.0001\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"0.0005\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"0.001\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"0.005\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"0.01\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"0.05\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"0.1\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"0.5\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"1.0\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"5.0\"} 0\n"
+            "apclient_validation_seconds_bucket{le=\"+Inf\"} 0\n"
+            "apclient_validation_seconds_sum 0\n"
+            "apclient_validation_seconds_count 0\n"
+            "# TYPE apclient_handler_seconds histogram\n"
+            "# HELP apclient_handler_seconds Time spent handling received commands, including callbacks.\n"
+            "# TYPE apclient_check_queue gauge\n"
+            "# HELP apclient_check_queue Queued location checks.\n"
+            "apclient_check_queue 0\n"
+            "# TYPE apclient_scout_queue gauge\n"
+            "# HELP apclient_scout_queue Queued location scouts.\n"
+            "apclient_scout_queue 0\n"
+            "# TYPE apclient_update_hint_queue gauge\n"
+            "# HELP apclient_update_hint_queue Queued hint updates.\n"
+            "apclient_update_hint_queue 0\n"
+            "# TYPE apclient_connect_attempts counter\n"
+            "# HELP apclient_connect_attempts Socket connection attempts.\n"
+            "apclient_connect_attempts_total 0\n"
+            "# TYPE apclient_reconnects counter\n"
+            "# HELP apclient_reconnects Connection attempts after a connection was lost.\n"
+            "apclient_reconnects_total 0\n"
+            "# TYPE apclient_time_to_connected_seconds histogram\n"
+            "# HELP apclient_time_to_connected_seconds Time from first connection attempt to slot connected.\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"0.1\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"0.25\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"0.5\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"1.0\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"2.5\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"5.0\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"10.0\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"30.0\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"60.0\"} 0\n"
+            "apclient_time_to_connected_seconds_bucket{le=\"+Inf\"} 0\n"
+            "apclient_time_to_connected_seconds_sum 0\n"
+            "apclient_time_to_connected_seconds_count 0\n"
+            "# EOF\n";
+    const std::string exposition = ap.get_metrics_openmetrics();
+    check(exposition == expected, "wrong exposition:\n" + exposition);
+}
+
+int main(int, char**)
+{
+    test_new_client();
+
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    int connects = 0;
+    bool disconnected = false;
+    APClient::Metrics queued;
+    std::string queuedExposition;
+    APClient::Metrics metrics;
+    std::string exposition;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        APClient::ReconnectPolicy policy;
+        policy.initialDelay = 50;
+        policy.maxDelay = 100;
+        ap.set_reconnect_policy(policy);
+        connect_on_room_info(ap, error);
+        ap.set_slot_connected_handler([&connects](const json&) {
+            connects++;
+        });
+        ap.set_socket_disconnected_handler([&ap, &disconnected]() {
+            disconnected = true;
+            ap.set_auto_reconnect(false); // until the queues are checked
+        });
+
+        check(poll_until(ap, [&]() { return error || connects == 1; }), "Timeout connecting");
+        poll_until(ap, []() { return false; }, std::chrono::milliseconds(50)); // FutureCommand
+        ap.Say("drop");
+        check(poll_until(ap, [&]() { return error || disconnected; }), "Timeout waiting for disconnect");
+        ap.LocationChecks({1, 2, 3});
+        ap.LocationScouts({4});
+        queued = ap.get_metrics();
+        queuedExposition = ap.get_metrics_openmetrics();
+        ap.set_auto_reconnect(true);
+        check(poll_until(ap, [&]() { return error || connects == 2; }), "Timeout reconnecting");
+        poll_until(ap, []() { return false; }, std::chrono::milliseconds(50));
+        metrics = ap.get_metrics();
+        exposition = ap.get_metrics_openmetrics();
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    check(queued.checkQueue == 3 && queued.scoutQueue == 1, "queue depths are " +
+          std::to_string(queued.checkQueue) + " and " + std::to_string(queued.scoutQueue));
+    check(has_line(queuedExposition, "apclient_check_queue 3") && has_line(queuedExposition, "apclient_scout_queue 1"),
+          "queue depths are not exported:\n" + queuedExposition);
+    check(metrics.checkQueue == 0, "check queue was not sent");
+
+    std::lock_guard<std::mutex> lock(serverMutex);
+    check(metrics.framesReceived == framesToClient && framesToClient == 4,
+          "received " + std::to_string(metrics.framesReceived) + " frames, server sent " +
+          std::to_string(framesToClient));
+    check(metrics.bytesReceived == bytesToClient, "received " + std::to_string(metrics.bytesReceived) +
+          " bytes, server sent " + std::to_string(bytesToClient));
+    check(metrics.bytesSent == bytesFromClient, "sent " + std::to_string(metrics.bytesSent) +
+          " bytes, server received " + std::to_string(bytesFromClient));
+    check(metrics.commandsSent["Connect"] == 2 && metrics.commandsSent["Say"] == 1,
+          "wrong commands sent: " + json(metrics.commandsSent).dump());
+    check(metrics.commandsReceived == std::map<std::string, uint64_t>{{"Connected", 2}, {"RoomInfo", 2},
+                                                                       {"other", 2}},
+          "wrong commands received: " + json(metrics.commandsReceived).dump());
+    check(metrics.parseTime.count == metrics.framesReceived, "parse histogram has " +
+          std::to_string(metrics.parseTime.count) + " observations");
+    for (const auto& cmd: {"Connected", "RoomInfo", "other"}) {
+        check(metrics.handlerTime[cmd].count == 2, std::string("handler histogram of ") + cmd + " has " +
+              std::to_string(metrics.handlerTime[cmd].count) + " observations");
+    }
+    check(metrics.connectAttempts == 2 && metrics.reconnects == 1, "connect attempts " +
+          std::to_string(metrics.connectAttempts) + ", reconnects " + std::to_string(metrics.reconnects));
+    check(metrics.timeToConnected.count == 2, "time to connected has " +
+          std::to_string(metrics.timeToConnected.count) + " observations");
+
+    for (const auto& line: std::vector<std::string>{
+            "apclient_received_frames_total 4",
+            "apclient_received_bytes_total " + std::to_string(bytesToClient),
+            "apclient_sent_commands_total{cmd=\"Connect\"} 2",
+            "apclient_received_commands_total{cmd=\"other\"} 2",
+            "apclient_handler_seconds_count{cmd=\"other\"} 2",
+            "apclient_handler_seconds_bucket{cmd=\"other\",le=\"+Inf\"} 2",
+            "apclient_parse_seconds_count 4",
+            "apclient_parse_seconds_bucket{le=\"+Inf\"} 4",
+            "apclient_check_queue 0",
+            "apclient_connect_attempts_total 2",
+            "apclient_reconnects_total 1",
+            "apclient_time_to_connected_seconds_count 2"}) {
+        check(has_line(exposition, line), "exposition is missing " + line);
+    }
+    return failures() ? 1 : 0;
+}
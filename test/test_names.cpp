@@ -0,0 +1,129 @@
+// Tests name lookups in a multiworld where games use the same ids: rendered nodes resolve through the game of their
+// player, fall back to Archipelago and follow alias changes, and games are interned into GameIds.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <list>
+#include <string>
+#include "testserver.hpp"
+
+static const json slotGames = {"Game A", "Game B"};
+static const json packageGames = {
+    {"Archipelago", make_game_data("Archipelago", -10, 5)},
+    {"Game A", make_game_data("Game A", 1000, 3)},
+    {"Game B", make_game_data("Game B", 1000, 3)}, // same ids as Game A
+};
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    server.send(hdl, json::array({make_room_info(slotGames, get_checksums(packageGames))}).dump());
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected_for(slotGames));
+        } else if (cmd == "GetDataPackage") {
+            reply.push_back(make_data_package(packageGames, command));
+        } else if (cmd == "Say") {
+            // rename slot 2
+            json players = make_connected_for(slotGames)["players"];
+            players[1]["alias"] = "Renamed";
+            reply.push_back({{"cmd", "RoomUpdate"}, {"players", players}});
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+static std::string render(const APClient& ap)
+{
+    const json nodes = {
+        {{"type", "player_id"}, {"text", "2"}},
+        {{"text", "|"}},
+        {{"type", "item_id"}, {"text", "1001"}, {"player", 2}, {"flags", 0}},
+        {{"text", "|"}},
+        {{"type", "location_id"}, {"text", "1002"}, {"player", 1}},
+        {{"text", "|"}},
+        {{"type", "item_id"}, {"text", "-9"}, {"player", 1}, {"flags", 0}}, // Archipelago's
+        {{"text", "|"}},
+        {{"type", "item_id"}, {"text", "1001"}, {"player", 0}, {"flags", 0}}, // not Archipelago's
+        {{"text", "|"}},
+        {{"type", "player_id"}, {"text", "0"}},
+    };
+    std::list<APClient::TextNode> msg;
+    for (const auto& node: nodes)
+        msg.push_back(APClient::TextNode::from_json(node));
+    return ap.render_json(msg);
+}
+
+static void check_game_ids(const APClient& ap)
+{
+    const auto gameA = ap.get_game_id("Game A");
+    const auto gameB = ap.get_game_id("Game B");
+    check(ap.get_game_id("Archipelago") == APClient::ARCHIPELAGO_GAME_ID, "Archipelago has the wrong id");
+    check(gameA != APClient::INVALID_GAME_ID && gameB != APClient::INVALID_GAME_ID, "games were not interned");
+    check(gameA != gameB && gameA != APClient::ARCHIPELAGO_GAME_ID && gameB != APClient::ARCHIPELAGO_GAME_ID,
+          "games share an id");
+    check(ap.get_game_id("Game C") == APClient::INVALID_GAME_ID, "unknown game has an id");
+    check(ap.get_game_name(gameA) == "Game A" && ap.get_game_name(gameB) == "Game B" &&
+          ap.get_game_name(APClient::ARCHIPELAGO_GAME_ID) == "Archipelago", "wrong name for game id");
+    check(ap.get_game_name(APClient::INVALID_GAME_ID).empty(), "invalid game id has a name");
+    check(ap.get_player_game_id(0) == APClient::ARCHIPELAGO_GAME_ID && ap.get_player_game_id(1) == gameA &&
+          ap.get_player_game_id(2) == gameB, "wrong game id for player");
+    check(ap.get_player_game_id(3) == APClient::INVALID_GAME_ID, "unknown player has a game id");
+    check(ap.get_item_name(1001, gameB) == "Game B Item 1" && ap.get_location_name(1000, gameA) == "Game A Location 0",
+          "wrong name by game id");
+    check(ap.get_item_name(-9, gameB) == "Archipelago Item 1", "Archipelago fallback by game id");
+    check(ap.get_item_name(1001, "Game C") == "Unknown", "name for unknown game");
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        MemoryDataPackageStore store;
+        APClient ap{"", "Game A", uri, "", &store};
+        bool connected = false;
+        bool dataPackage = false;
+        connect_on_room_info(ap, error);
+        ap.set_slot_connected_handler([&connected](const json&) {
+            connected = true;
+        });
+        ap.set_data_package_changed_handler([&dataPackage](const json&) {
+            dataPackage = true;
+        });
+
+        poll_until(ap, [&]() { return error || (connected && dataPackage); });
+        check(connected && dataPackage, "did not connect and receive the data package");
+
+        std::string text = render(ap);
+        check(text == "Player2|Game B Item 1|Game A Location 2|Archipelago Item 1|Unknown|Server",
+              "rendered \"" + text + "\"");
+
+        // the table follows alias changes
+        ap.Say("rename");
+        poll_until(ap, [&]() { return error || ap.get_player_alias(2) == "Renamed"; });
+        text = render(ap);
+        check(text == "Renamed|Game B Item 1|Game A Location 2|Archipelago Item 1|Unknown|Server",
+              "rendered \"" + text + "\" after renaming");
+
+        // same names through the string API
+        check(ap.get_item_name(1001, "Game B") == "Game B Item 1", "item name by game name");
+        check(ap.get_location_name(1002, ap.get_player_game(1)) == "Game A Location 2",
+              "location name by player game");
+        check(ap.get_item_name(-9, "Game A") == "Archipelago Item 1", "Archipelago fallback by game name");
+        check_game_ids(ap);
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// Tests that a dropped connection is retried right away with the default reconnect policy and after the reconnect
+// delay with a jittered one, and that invalid reconnect policies are sanitized.
+
+#include <apclient.hpp>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <string>
+#include "testserver.hpp"
+
+static std::mutex connectionMutex;
+static websocketpp::connection_hdl connection;
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    {
+        std::lock_guard<std::mutex> lock(connectionMutex);
+        connection = hdl;
+    }
+    send_room_info(server, hdl);
+}
+
+/// Connect, drop the connection after keepMs and return the time until the reconnect in ms, -1 on failure
+static long long drop_and_reconnect(TestServer& server, const std::string& uri, const APClient::ReconnectPolicy* policy,
+                                    unsigned long keepMs)
+{
+    bool error = false;
+    int connects = 0;
+    bool disconnected = false;
+    bool closed = false;
+    std::chrono::steady_clock::time_point disconnectTime;
+    std::chrono::steady_clock::time_point reconnectTime;
+
+    printf("Starting client for %s...\n", uri.c_str());
+    APClient ap{"", "", uri};
+    if (policy)
+        ap.set_reconnect_policy(*policy);
+    report_socket_errors(ap, error);
+    ap.set_socket_connected_handler([&connects, &reconnectTime]() {
+        connects++;
+        reconnectTime = std::chrono::steady_clock::now();
+    });
+    ap.set_socket_disconnected_handler([&disconnected, &disconnectTime]() {
+        disconnected = true;
+        disconnectTime = std::chrono::steady_clock::now();
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    poll_until(ap, [&]() {
+        if (error || connects > 1)
+            return true;
+        // keep the connection for longer than the longest reconnect delay, then drop it
+        if (!closed && connects == 1 && std::chrono::steady_clock::now() - start >
+                std::chrono::milliseconds(keepMs)) {
+            std::lock_guard<std::mutex> lock(connectionMutex);
+            server.close(connection);
+            closed = true;
+        }
+        return false;
+    }, std::chrono::milliseconds(keepMs + 5000));
+    printf("Stopping client...\n");
+
+    check(!error, "Error");
+    check(disconnected, "Connection was not dropped");
+    check(connects == 2, "Connected " + std::to_string(connects) + " times");
+    if (error || !disconnected || connects != 2)
+        return -1;
+    const auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(reconnectTime - disconnectTime);
+    printf("Reconnected after %d ms\n", static_cast<int>(delay.count()));
+    return delay.count();
+}
+
+int main(int, char**)
+{
+    ScopedTestServer scopedServer{on_open};
+    TestServer& server = scopedServer.server;
+    const std::string uri = scopedServer.get_uri();
+
+    // invalid policies are sanitized
+    {
+        APClient ap{"", "", uri};
+        APClient::ReconnectPolicy invalid;
+        invalid.initialDelay = 0;
+        invalid.multiplier = std::numeric_limits<double>::quiet_NaN();
+        ap.set_reconnect_policy(invalid);
+        check(ap.get_reconnect_policy().multiplier == 1, "NaN multiplier was not replaced");
+        check(ap.get_reconnect_policy().initialDelay > 0, "initial delay of 0 was not replaced");
+        invalid.multiplier = std::numeric_limits<double>::infinity();
+        ap.set_reconnect_policy(invalid);
+        check(ap.get_reconnect_policy().multiplier == 1, "infinite multiplier was not replaced");
+    }
+
+    // the default policy retries a connection that was up for longer than the initial delay on the next poll
+    const APClient::ReconnectPolicy defaultPolicy;
+    auto delay = drop_and_reconnect(server, uri, nullptr, defaultPolicy.initialDelay + 500);
+    check(delay < 0 || delay < static_cast<long long>(defaultPolicy.initialDelay / 3),
+          "Default policy reconnected after " + std::to_string(delay) + " ms, not right away");
+
+    // a jittered reconnect waits at least the initial delay after the disconnect
+    APClient::ReconnectPolicy policy;
+    policy.initialDelay = 300;
+    policy.maxDelay = 2 * policy.initialDelay;
+    policy.jitter = APClient::ReconnectPolicy::Jitter::DECORRELATED;
+    delay = drop_and_reconnect(server, uri, &policy, 3 * policy.maxDelay);
+    check(delay < 0 || delay >= static_cast<long long>(policy.initialDelay),
+          "Jittered policy reconnected after " + std::to_string(delay) + " ms, before the reconnect delay");
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+// Tests parsing of text colors and rendering of PrintJSON nodes to ANSI and HTML, and, where a test server can run,
+// that the TextMessage print_json handler receives the nodes of a PrintJSON.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#ifndef __EMSCRIPTEN__
+#include "testserver.hpp"
+#else
+static int& failures()
+{
+    static int n = 0;
+    return n;
+}
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what.c_str());
+        failures()++;
+    }
+}
+#endif
+
+using TextColor = APClient::TextColor;
+
+static const std::map<std::string, TextColor> colors = {
+    {"bold", TextColor::BOLD},
+    {"underline", TextColor::UNDERLINE},
+    {"black", TextColor::BLACK},
+    {"red", TextColor::RED},
+    {"green", TextColor::GREEN},
+    {"yellow", TextColor::YELLOW},
+    {"blue", TextColor::BLUE},
+    {"magenta", TextColor::MAGENTA},
+    {"cyan", TextColor::CYAN},
+    {"white", TextColor::WHITE},
+    {"black_bg", TextColor::BLACK_BG},
+    {"red_bg", TextColor::RED_BG},
+    {"green_bg", TextColor::GREEN_BG},
+    {"yellow_bg", TextColor::YELLOW_BG},
+    {"blue_bg", TextColor::BLUE_BG},
+    {"magenta_bg", TextColor::MAGENTA_BG},
+    {"cyan_bg", TextColor::CYAN_BG},
+    {"white_bg", TextColor::WHITE_BG},
+    {"plum", TextColor::PLUM},
+    {"slateblue", TextColor::SLATEBLUE},
+    {"salmon", TextColor::SALMON},
+    {"gray", TextColor::GRAY},
+    {"grey", TextColor::GRAY},
+};
+
+// parsing has to work at compile time
+static_assert(APClient::parse_text_color("red", 3) == TextColor::RED, "constexpr parse_text_color");
+
+static void test_parse_text_color()
+{
+    for (const auto& pair: colors) {
+        check(APClient::parse_text_color(pair.first) == pair.second, "parse_text_color(\"" + pair.first + "\")");
+    }
+    check(APClient::parse_text_color("") == TextColor::NONE, "parse_text_color(\"\")");
+    for (const char* name: {"r", "re", "bl", "purple", "Red", "RED", "redd", "bold ", " bold", "gray_bg",
+                            "salmon_bg", "underlin", "underlinee", "slate"}) {
+        check(APClient::parse_text_color(name) == TextColor::UNKNOWN,
+              std::string("parse_text_color(\"") + name + "\") is not UNKNOWN");
+    }
+    // no other short name may hit a known one
+    const std::string alphabet = "abcdefghijklmnopqrstuvwxyz_";
+    for (size_t len = 1; len <= 4; len++) {
+        std::string name(len, alphabet[0]);
+        std::vector<size_t> digits(len, 0);
+        while (true) {
+            const auto color = APClient::parse_text_color(name);
+            if (!colors.count(name) && color != TextColor::UNKNOWN)
+                check(false, "parse_text_color(\"" + name + "\") is not UNKNOWN");
+            size_t i = 0;
+            while (i < len && ++digits[i] == alphabet.size()) {
+                digits[i] = 0;
+                name[i] = alphabet[0];
+                i++;
+            }
+            if (i == len)
+                break;
+            name[i] = alphabet[digits[i]];
+        }
+    }
+}
+
+static void test_render_html()
+{
+    APClient ap{"", "", ""};
+    std::list<APClient::TextNode> msg;
+    APClient::TextNode plain;
+    plain.text = "a<&>\"'b";
+    msg.push_back(plain);
+    APClient::TextNode colored;
+    colored.color = "red";
+    colored.text = "<&>\"'";
+    msg.push_back(colored);
+    const auto html = ap.render_json(msg, APClient::RenderFormat::HTML);
+    const std::string expected = "a&lt;&amp;&gt;&quot;&#39;b"
+                                 "<span style=\"color:red\">&lt;&amp;&gt;&quot;&#39;</span>";
+    check(html == expected, "render_json to HTML is " + html + ", expected " + expected);
+
+    // the appending overload keeps what is already there
+    std::string out = "<p>";
+    ap.render_json(out, msg, APClient::RenderFormat::HTML);
+    check(out == "<p>" + expected, "render_json appended " + out);
+
+    // text is not escaped
+    check(ap.render_json(msg, APClient::RenderFormat::TEXT) == "a<&>\"'b<&>\"'", "render_json to TEXT");
+}
+
+static void test_render_ansi()
+{
+    APClient ap{"", "", ""};
+    std::list<APClient::TextNode> msg;
+    for (const auto& pair: std::vector<std::pair<std::string, std::string>>{
+            {"red_bg", "bg"}, {"yellow", "y"}, {"bold", "b"}, {"green", "g"}, {"", "plain"}}) {
+        APClient::TextNode node;
+        node.color = pair.first;
+        node.text = pair.second;
+        msg.push_back(node);
+    }
+    // background and bold must not carry over to the following nodes
+    const auto ansi = ap.render_json(msg, APClient::RenderFormat::ANSI);
+    const std::string expected = "\x1b[0;41mbg\x1b[0;33my\x1b[0;1mb\x1b[0;32mg\x1b[0mplain";
+    check(ansi == expected, "render_json to ANSI is " + nlohmann::json(ansi).dump() + ", expected " +
+                            nlohmann::json(expected).dump());
+}
+
+static void test_text_message()
+{
+    APClient ap{"", "", ""};
+    const auto data = nlohmann::json::parse(R"json([
+        {"text": "a<b"},
+        {"type": "player_id", "text": "1"},
+        {"type": "item_id", "text": "77", "player": 1, "flags": 1},
+        {"type": "location_id", "text": "88", "player": 1},
+        {"type": "hint_status", "text": "(found)", "hint_status": 40},
+        {"type": "color", "color": "red", "text": "\u001b[0m"},
+        {"type": "unknown_type", "color": "not_a_color", "text": "x"},
+        {}
+    ])json");
+    std::list<APClient::TextNode> list;
+    for (const auto& part: data)
+        list.push_back(APClient::TextNode::from_json(part));
+    const auto msg = APClient::TextMessage::from_json(data);
+
+    check(msg.nodes.size() == data.size(), "TextMessage has " + std::to_string(msg.nodes.size()) + " nodes");
+    check(msg.buffer == "a<b17788(found)\x1b[0mx", "TextMessage buffer is " + msg.buffer);
+    auto it = list.begin();
+    for (const auto& node: msg.nodes) {
+        const auto text = msg.get_text(node);
+        check(text == it->text && text.data == msg.buffer.data() + node.textOffset,
+              "TextMessage node text " + text.str() + ", expected " + it->text);
+        check(node.type == it->nodeType && node.color == it->textColor && node.id == it->id &&
+              node.player == it->player && node.flags == it->flags && node.hintStatus == it->hintStatus,
+              "TextMessage node " + it->text + " does not match TextNode");
+        ++it;
+    }
+    for (auto fmt: {APClient::RenderFormat::TEXT, APClient::RenderFormat::ANSI, APClient::RenderFormat::HTML}) {
+        const auto expected = ap.render_json(list, fmt);
+        const auto rendered = ap.render_json(msg, fmt);
+        check(rendered == expected, "render_json of TextMessage is " + rendered + ", expected " + expected);
+        std::string out = "<p>";
+        ap.render_json(out, msg, fmt);
+        check(out == "<p>" + expected, "render_json of TextMessage appended " + out);
+    }
+}
+
+#ifndef __EMSCRIPTEN__
+static const nlohmann::json printJsonData = {
+    {{"type", "player_id"}, {"text", "1"}},
+    {{"text", " found "}},
+    {{"type", "item_id"}, {"text", "77"}, {"player", 1}, {"flags", 1}},
+    {{"text", " at "}},
+    {{"type", "location_id"}, {"text", "88"}, {"player", 1}},
+};
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    const nlohmann::json printJson = {{"cmd", "PrintJSON"}, {"type", "ItemSend"}, {"data", printJsonData}};
+    server.send(hdl, nlohmann::json::array({make_room_info(), printJson}).dump());
+}
+
+static void test_print_json_handler()
+{
+    ScopedTestServer server{on_open};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    int messages = 0;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        report_socket_errors(ap, error);
+        std::list<APClient::TextNode> list;
+        for (const auto& part: printJsonData)
+            list.push_back(APClient::TextNode::from_json(part));
+        ap.set_print_json_handler([&](const APClient::TextMessage& msg) {
+            messages++;
+            check(msg.nodes.size() == printJsonData.size(),
+                  "print_json handler got " + std::to_string(msg.nodes.size()) + " nodes");
+            const auto rendered = ap.render_json(msg, APClient::RenderFormat::TEXT);
+            const auto expected = ap.render_json(list, APClient::RenderFormat::TEXT);
+            check(rendered == expected, "print_json handler message is " + rendered + ", expected " + expected);
+        });
+        check(poll_until(ap, [&]() { return error || messages > 0; }), "Timeout waiting for PrintJSON");
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    check(messages == 1, "print_json handler was called " + std::to_string(messages) + " times");
+}
+#endif
+
+int main(int, char**)
+{
+    test_parse_text_color();
+    test_render_html();
+    test_render_ansi();
+    test_text_message();
+#ifndef __EMSCRIPTEN__
+    test_print_json_handler();
+#endif
+    return failures() ? 1 : 0;
+}
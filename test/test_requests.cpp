@@ -0,0 +1,140 @@
+// Tests that replies are matched to get_async and set_async requests, also if other clients' replies look similar,
+// and that scout_async replies are matched, also if the server does not reply to a scout.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "testserver.hpp"
+
+/// The same extras as sent by a different client that happens to use the same request id
+static json get_foreign_extras(const json& command)
+{
+    json extras = get_extras(command);
+    for (auto& value: extras) {
+        if (value.is_number_unsigned())
+            value = value.get<uint64_t>() + 1; // different nonce
+    }
+    extras["apclientpp_request_id"] = command.at("apclientpp_request_id");
+    return extras;
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "Get") {
+            const auto key = command["keys"][0].get<std::string>();
+            // SetReply is sent to all clients that called SetNotify
+            json foreignSetReply = {{"cmd", "SetReply"}, {"key", key}, {"value", -1}, {"original_value", 0}};
+            foreignSetReply.update(get_foreign_extras(command));
+            reply.push_back(foreignSetReply);
+            // wrong type of reply with our tag
+            json wrongType = {{"cmd", "SetReply"}, {"key", key}, {"value", -2}, {"original_value", 0}};
+            wrongType.update(get_extras(command));
+            reply.push_back(wrongType);
+            // the actual reply
+            json retrieved = {{"cmd", "Retrieved"}, {"keys", {{key, 42}}}};
+            retrieved.update(get_extras(command));
+            reply.push_back(retrieved);
+        } else if (cmd == "Set") {
+            const auto key = command["key"].get<std::string>();
+            json foreignSetReply = {{"cmd", "SetReply"}, {"key", key}, {"value", -1}, {"original_value", 0}};
+            foreignSetReply.update(get_foreign_extras(command));
+            reply.push_back(foreignSetReply);
+            json wrongType = {{"cmd", "Retrieved"}, {"keys", {{key, -2}}}};
+            wrongType.update(get_extras(command));
+            reply.push_back(wrongType);
+            json setReply = {{"cmd", "SetReply"}, {"key", key}, {"value", command["operations"][0]["value"]},
+                             {"original_value", 0}};
+            setReply.update(get_extras(command));
+            reply.push_back(setReply);
+        } else if (cmd == "LocationScouts") {
+            // location 1 gets no reply at all and location 5 is filtered from the reply
+            json locations = json::array();
+            for (const auto& location: command["locations"]) {
+                if (location == 1) {
+                    locations = nullptr;
+                    break;
+                }
+                if (location != 5) {
+                    locations.push_back({{"item", 100}, {"location", location}, {"player", 1}, {"flags", 0},
+                                         {"class", "NetworkItem"}});
+                }
+            }
+            if (!locations.is_null())
+                reply.push_back({{"cmd", "LocationInfo"}, {"locations", locations}});
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    int getCalls = 0;
+    json getResult;
+    int setCalls = 0;
+    json setResult;
+    std::vector<int> scoutResults; // -1 for failure, number of items otherwise
+    bool error = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        connect_on_room_info(ap, error);
+        ap.set_slot_connected_handler([&](const json&) {
+            ap.get_async({"key"}, [&getCalls, &getResult](bool success, const json& keys) {
+                getCalls++;
+                getResult = success ? keys : json();
+            }, 5000);
+            ap.set_async("key", 0, {{"replace", 7}}, [&setCalls, &setResult](bool success, const json& reply) {
+                setCalls++;
+                setResult = success ? reply : json();
+            }, 5000);
+            for (const auto& locations: std::vector<std::list<int64_t>>{{1}, {2, 3}, {4, 5}}) {
+                ap.scout_async(locations, 0,
+                               [&scoutResults](bool success, const std::list<APClient::NetworkItem>& items) {
+                    scoutResults.push_back(success ? static_cast<int>(items.size()) : -1);
+                }, 5000);
+            }
+        });
+        poll_until(ap, [&]() { return error || (getCalls && setCalls && scoutResults.size() == 3); });
+        for (int i = 0; i < 10; i++) {
+            ap.poll(); // nothing else may complete the requests
+            usleep(100);
+        }
+        printf("Stopping client...\n");
+    }
+
+    if (error) {
+        fprintf(stderr, "FAIL: Error\n");
+        return 1;
+    }
+    if (getCalls != 1 || setCalls != 1) {
+        fprintf(stderr, "FAIL: Callbacks called %d and %d times\n", getCalls, setCalls);
+        return 1;
+    }
+    if (!getResult.is_object() || getResult.value("key", json()) != 42) {
+        fprintf(stderr, "FAIL: Get completed with %s\n", getResult.dump().c_str());
+        return 1;
+    }
+    if (!setResult.is_object() || setResult.value("cmd", "") != "SetReply"
+            || setResult.value("value", json()) != 7) {
+        fprintf(stderr, "FAIL: Set completed with %s\n", setResult.dump().c_str());
+        return 1;
+    }
+    if (scoutResults != std::vector<int>{-1, 2, 1}) {
+        std::string results;
+        for (int result: scoutResults)
+            results += " " + std::to_string(result);
+        fprintf(stderr, "FAIL: Scouts completed with%s\n", results.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Tests automatic resume: the slot is connected again after a reconnect to the same room, but not after a reconnect
+// to a different room, and ConnectSlot while resuming is only skipped if its arguments match the resumed ones.
+
+#include <apclient.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "testserver.hpp"
+
+static std::mutex serverMutex;
+static const std::vector<std::string> seeds = {"room", "room", "other room"}; // RoomInfo seed by connection
+static size_t connection = 0; // current connection, 1-based
+static std::vector<std::vector<std::string>> passwords(seeds.size()); // passwords of Connects by connection
+
+static void on_open(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    connection++;
+    json roomInfo = make_room_info();
+    roomInfo["seed_name"] = seeds[std::min(connection, seeds.size()) - 1];
+    server.send(hdl, json::array({roomInfo}).dump());
+}
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    for (const auto& command: json::parse(message)) {
+        if (command.value("cmd", "") != "Connect" || connection > seeds.size())
+            continue;
+        auto& connects = passwords[connection - 1];
+        connects.push_back(command["password"]);
+        server.send(hdl, json::array({make_connected()}).dump());
+        // drop the first connection once connected and the second once the replaced resume arrived
+        if ((connection == 1 && connects.size() == 1) || (connection == 2 && connects.size() == 2))
+            server.close(hdl);
+    }
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{on_open, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    int roomInfos = 0;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        APClient::ReconnectPolicy policy;
+        policy.initialDelay = 50;
+        policy.maxDelay = 100;
+        ap.set_reconnect_policy(policy);
+        ap.set_auto_resume(true);
+        report_socket_errors(ap, error);
+        ap.set_room_info_handler([&ap, &roomInfos]() {
+            roomInfos++;
+            if (roomInfos == 1) {
+                ap.ConnectSlot("Player", "", 0b111);
+            } else if (roomInfos == 2) {
+                ap.ConnectSlot("Player", "", 0b111); // same as the resume, skipped
+                ap.ConnectSlot("Player", "new", 0b111); // replaces the resume
+            }
+        });
+
+        check(poll_until(ap, [&]() { return error || roomInfos >= 3; }), "Timeout");
+        // give a wrong resume time to arrive
+        poll_until(ap, []() { return false; }, std::chrono::milliseconds(500));
+        check(ap.get_state() == APClient::State::ROOM_INFO, "slot was connected in a different room");
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    std::lock_guard<std::mutex> lock(serverMutex);
+    check(passwords[0] == std::vector<std::string>{""}, "wrong Connects on the first connection");
+    check(passwords[1] == std::vector<std::string>{"", "new"},
+          "wrong Connects on the second connection, expected the resume and the replaced arguments");
+    check(passwords[2].empty(), "slot was resumed in a different room");
+    return failures() ? 1 : 0;
+}
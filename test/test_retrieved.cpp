@@ -0,0 +1,91 @@
+// Tests the retrieved handler variants: each one receives the same values of a Retrieved packet, and setting one
+// replaces the others.
+
+#include <apclient.hpp>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "testserver.hpp"
+
+static const json storage = {{"int", 1}, {"list", {1, 2}}, {"dict", {{"x", "y"}}}, {"string", "abc"}};
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect")
+            reply.push_back(make_connected());
+        else if (cmd == "Get")
+            reply.push_back(make_retrieved(storage, command));
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+/// A call of one of the retrieved handlers
+struct Call {
+    std::string handler;
+    json keys;
+    std::string cmd; ///< cmd of the message, if the handler receives it
+};
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    bool connected = false;
+    std::vector<Call> calls;
+    const json expected = {{"int", 1}, {"list", {1, 2}}, {"dict", {{"x", "y"}}}, {"string", "abc"}, {"none", nullptr}};
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        connect_on_room_info(ap, error);
+        ap.set_slot_connected_handler([&connected](const json&) {
+            connected = true;
+        });
+        check(poll_until(ap, [&]() { return error || connected; }), "Timeout connecting");
+
+        auto setMap = [&]() {
+            ap.set_retrieved_handler([&calls](const std::map<std::string, json>& keys) {
+                calls.push_back({"map", json(keys), ""});
+            });
+        };
+        auto setMapMessage = [&]() {
+            ap.set_retrieved_handler([&calls](const std::map<std::string, json>& keys, const json& message) {
+                calls.push_back({"map+message", json(keys), message.value("cmd", "")});
+            });
+        };
+        auto setJson = [&]() {
+            ap.set_retrieved_json_handler([&calls](const json& keys, const json& message) {
+                calls.push_back({"json", keys, message.value("cmd", "")});
+            });
+        };
+        // each setter replaces the handler set before it
+        for (const auto& set: std::vector<std::function<void()>>{setMap, setMapMessage, setJson, setMap}) {
+            set();
+            const auto count = calls.size();
+            ap.Get({"int", "list", "dict", "string", "none"});
+            check(poll_until(ap, [&]() { return error || calls.size() > count; }), "Timeout waiting for Retrieved");
+        }
+        poll_until(ap, []() { return false; }, std::chrono::milliseconds(100)); // no late duplicates
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    std::string handlers;
+    for (const auto& call: calls)
+        handlers += " " + call.handler;
+    check(handlers == " map map+message json map", "wrong handlers called:" + handlers);
+    for (const auto& call: calls) {
+        check(call.keys == expected, call.handler + " handler received " + call.keys.dump());
+        if (call.handler != "map")
+            check(call.cmd == "Retrieved", call.handler + " handler received message " + call.cmd);
+    }
+    return failures() ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+// Tests racing ws:// and wss:// with scripted sockets: the preferred wss:// gets a head start, so it wins if both
+// schemes work, and ws:// is used right away if wss:// fails or after the head start if wss:// does not answer.
+
+#include <apclient.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Result = wswrap::MockScheme::Result;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static std::string join(const std::vector<std::string>& uris)
+{
+    std::string s;
+    for (const auto& uri: uris)
+        s += " " + uri;
+    return s;
+}
+
+/// Connect to host without scheme. Returns the ms until the socket was connected, or -1.
+static long connect(const std::string& host, bool& error)
+{
+    wswrap::mock_connects().clear();
+    error = false;
+    const auto start = std::chrono::steady_clock::now();
+    APClient ap{"", "", host};
+    ap.set_socket_error_handler([&error](const std::string&) {
+        error = true;
+    });
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        ap.poll();
+        if (ap.get_state() == APClient::State::SOCKET_CONNECTED) {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            // keep polling for a bit, the loser must not replace the winner
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ap.poll();
+            const auto open = wswrap::mock_open_sockets();
+            check(open.size() == 1, host + ": open sockets:" + join(open));
+            return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return -1;
+}
+
+int main(int, char**)
+{
+    bool error;
+
+    // both work, plain is faster
+    wswrap::mock_scheme("ws", Result::OPEN);
+    wswrap::mock_scheme("wss", Result::OPEN, 100);
+    check(connect("both:38281", error) >= 0 && !error, "could not connect if both schemes work");
+    check(wswrap::mock_connects() == std::vector<std::string>{"wss://both:38281"},
+          "connected to" + join(wswrap::mock_connects()) + " if both schemes work");
+    // wss:// was remembered
+    wswrap::mock_scheme("wss", Result::OPEN);
+    check(connect("both:38281", error) >= 0 && !error, "could not connect again");
+    check(wswrap::mock_connects() == std::vector<std::string>{"wss://both:38281"},
+          "connected to" + join(wswrap::mock_connects()) + " again");
+
+    // wss:// fails, ws:// is tried without waiting for the head start
+    wswrap::mock_scheme("wss", Result::FAIL, 20);
+    const auto plain = connect("plain:38281", error);
+    check(plain >= 0 && !error, "could not connect if wss fails");
+    check(plain < 250, "waited " + std::to_string(plain) + "ms after wss failed");
+    check(wswrap::mock_connects() == std::vector<std::string>{"wss://plain:38281", "ws://plain:38281"},
+          "connected to" + join(wswrap::mock_connects()) + " if wss fails");
+
+    // wss:// does not answer, ws:// is tried after the head start
+    wswrap::mock_scheme("wss", Result::HANG);
+    const auto hanging = connect("hanging:38281", error);
+    check(hanging >= 250 && !error, "connected after " + std::to_string(hanging) + "ms if wss does not answer");
+    check(wswrap::mock_connects() == std::vector<std::string>{"wss://hanging:38281", "ws://hanging:38281"},
+          "connected to" + join(wswrap::mock_connects()) + " if wss does not answer");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+// Tests reference counted data storage subscriptions: keys are only sent once, also when subscribing from the slot
+// connected handler, and stay subscribed until the last subscriber is gone.
+
+#include <apclient.hpp>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include "testserver.hpp"
+
+static std::mutex serverMutex;
+static json setNotifies = json::array(); // keys of each SetNotify
+static json gets = json::array(); // keys of each Get
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(serverMutex);
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "SetNotify") {
+            setNotifies.push_back(command["keys"]);
+        } else if (cmd == "Get") {
+            gets.push_back(command["keys"]);
+            reply.push_back(make_retrieved(json::object(), command));
+        }
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    bool done = false;
+    std::set<std::string> subscriptions;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        connect_on_room_info(ap, error);
+        ap.subscribe_data_storage("x", {"a"});
+        ap.subscribe_data_storage("y", {"a", "b"});
+        ap.set_slot_connected_handler([&ap](const json&) {
+            ap.subscribe_data_storage("x", {"c"}); // new key, sent once
+            ap.subscribe_data_storage("z", {"a"}); // already subscribed
+            ap.Get({"done"});
+        });
+        ap.set_retrieved_handler([&done](const std::map<std::string, json>& keys) {
+            if (keys.count("done"))
+                done = true;
+        });
+        check(poll_until(ap, [&]() { return error || done; }), "Timeout");
+        ap.unsubscribe_data_storage("x");
+        ap.unsubscribe_data_storage("y", {"b"});
+        subscriptions = ap.get_data_storage_subscriptions();
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    check(subscriptions == std::set<std::string>{"a"}, "Keys that lost all subscribers are still subscribed");
+    std::lock_guard<std::mutex> lock(serverMutex);
+    check(setNotifies == json{{"a", "b"}, {"c"}}, "Wrong SetNotify sent: " + setNotifies.dump());
+    check(gets == json{{"a", "b"}, {"c"}, {"done"}}, "Wrong Get sent: " + gets.dump());
+    return failures() ? 1 : 0;
+}
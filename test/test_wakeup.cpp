@@ -0,0 +1,105 @@
+// Tests next_wakeup: 0 while work is due, ULONG_MAX when idle, and the time until a request times out, batched
+// writes are flushed or the socket is reconnected.
+
+#include <apclient.hpp>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "testserver.hpp"
+
+static void on_message(TestServer& server, const websocketpp::connection_hdl& hdl, const std::string& message)
+{
+    json reply = json::array();
+    for (const auto& command: json::parse(message)) {
+        const auto cmd = command.value("cmd", "");
+        if (cmd == "Connect") {
+            reply.push_back(make_connected());
+        } else if (cmd == "Say") {
+            server.close(hdl); // drop the connection
+            return;
+        }
+        // Get is not answered, so requests time out
+    }
+    if (!reply.empty())
+        server.send(hdl, reply.dump());
+}
+
+static void sleep_ms(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+int main(int, char**)
+{
+    ScopedTestServer server{send_room_info, on_message};
+    const std::string uri = server.get_uri();
+
+    bool error = false;
+    bool connected = false;
+    bool disconnected = false;
+    {
+        printf("Starting client for %s...\n", uri.c_str());
+        APClient ap{"", "", uri};
+        APClient::ReconnectPolicy policy;
+        policy.initialDelay = 1000;
+        policy.maxDelay = 1000;
+        policy.multiplier = 1;
+        policy.jitter = APClient::ReconnectPolicy::Jitter::DECORRELATED; // exactly 1s after the disconnect
+        ap.set_reconnect_policy(policy);
+        connect_on_room_info(ap, error);
+        ap.set_slot_connected_handler([&connected](const json&) {
+            connected = true;
+        });
+        ap.set_socket_disconnected_handler([&disconnected]() {
+            disconnected = true;
+        });
+
+        check(ap.next_wakeup() == 0, "new client does not want to connect right away");
+        check(poll_until(ap, [&]() { return error || connected; }), "Timeout connecting");
+        check(ap.next_wakeup() == ULONG_MAX, "connected client without work wakes up after " +
+                                             std::to_string(ap.next_wakeup()) + " ms");
+
+        // request timeout
+        bool timedOut = false;
+        ap.get_async({"key"}, [&timedOut](bool success, const json&) {
+            timedOut = !success;
+        }, 300);
+        auto wakeup = ap.next_wakeup();
+        check(wakeup > 0 && wakeup <= 300, "pending request wakes up after " + std::to_string(wakeup) + " ms");
+        sleep_ms(350);
+        check(ap.next_wakeup() == 0, "timed out request is not due");
+        ap.poll();
+        check(timedOut, "request did not time out");
+        check(ap.next_wakeup() == ULONG_MAX, "timed out request still wakes up");
+
+        // batched write flush
+        ap.set_data_storage_write_batching(true, 300);
+        ap.Set("key", 0, false, {{"add", 1}});
+        check(ap.next_wakeup() == 0, "first batched write is not due");
+        ap.poll(); // flushes, the interval counts from here
+        ap.Set("key", 0, false, {{"add", 1}});
+        wakeup = ap.next_wakeup();
+        check(wakeup > 0 && wakeup <= 300, "batched write wakes up after " + std::to_string(wakeup) + " ms");
+        sleep_ms(350);
+        check(ap.next_wakeup() == 0, "batched write is not due");
+        ap.poll();
+        check(ap.next_wakeup() == ULONG_MAX, "flushed write still wakes up");
+
+        // reconnect delay
+        ap.Say("drop");
+        check(poll_until(ap, [&]() { return error || disconnected; }), "Timeout waiting for disconnect");
+        ap.poll(); // cleans up the socket
+        wakeup = ap.next_wakeup();
+        check(wakeup > 500 && wakeup <= policy.initialDelay + 1, "reconnect wakes up after " +
+                                                                 std::to_string(wakeup) + " ms");
+        ap.set_auto_reconnect(false);
+        check(ap.next_wakeup() == ULONG_MAX, "disconnected client without auto reconnect wakes up after " +
+                                             std::to_string(ap.next_wakeup()) + " ms");
+        printf("Stopping client...\n");
+    }
+
+    check(!error, "Error");
+    return failures() ? 1 : 0;
+}
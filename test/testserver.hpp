@@ -0,0 +1,394 @@
+// Websocket server and shared helpers for tests. Handlers run on the server thread.
+
+#ifndef _TESTSERVER_HPP
+#define _TESTSERVER_HPP
+
+#include <apclient.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <websocketpp/server.hpp>
+#include <websocketpp/config/asio_no_tls.hpp>
+
+typedef websocketpp::server<websocketpp::config::asio> Server;
+
+class TestServer final {
+public:
+    typedef std::function<void(TestServer&, const websocketpp::connection_hdl&)> OpenHandler;
+    typedef std::function<void(TestServer&, const websocketpp::connection_hdl&, const std::string&)> MessageHandler;
+
+    explicit TestServer(const uint16_t preferredPort, const uint16_t maxPort=0,
+                        OpenHandler onOpen=nullptr, MessageHandler onMessage=nullptr)
+        : port(preferredPort), maxPort(maxPort == 0 ? preferredPort : maxPort),
+          onOpen(std::move(onOpen)), onMessage(std::move(onMessage))
+    {
+        server.set_error_channels(websocketpp::log::elevel::fatal);
+        server.set_access_channels(websocketpp::log::alevel::none);
+        server.init_asio();
+
+        server.set_open_handler([this](const websocketpp::connection_hdl& hdl) {
+            if (this->onOpen)
+                this->onOpen(*this, hdl);
+        });
+        server.set_message_handler([this](const websocketpp::connection_hdl& hdl, const Server::message_ptr& msg) {
+            if (this->onMessage)
+                this->onMessage(*this, hdl, msg->get_payload());
+        });
+    }
+
+    ~TestServer()
+    {
+        try {
+            if (running)
+                stop();
+        } catch (...) {}
+    }
+
+    void run()
+    {
+        running = true;
+        while (true) {
+            try {
+                server.listen(port);
+                break;
+            } catch (const websocketpp::exception&) {
+                if (port == maxPort)
+                    throw;
+                port += 1;
+            }
+        }
+        server.start_accept();
+        server.run();
+    }
+
+    /// Run the server on a new thread and wait for it to listen
+    std::thread start()
+    {
+        std::thread thread(&TestServer::run, this);
+        for (int i=0; i<10; i++) {
+            std::this_thread::sleep_for(std::chrono::microseconds(2000));
+            if (is_listening())
+                break;
+        }
+        if (!is_listening()) {
+            thread.detach();
+            throw std::runtime_error("Timeout starting server");
+        }
+        return thread;
+    }
+
+    void stop()
+    {
+        server.stop_listening();
+        //server.stop();
+        running = false;
+    }
+
+    bool is_listening() const
+    {
+        return server.is_listening();
+    }
+
+    uint16_t get_port() const
+    {
+        return port;
+    }
+
+    void send(const websocketpp::connection_hdl& hdl, const std::string& message)
+    {
+        server.send(hdl, message, websocketpp::frame::opcode::text);
+    }
+
+    /// Close a client connection from the server side
+    void close(const websocketpp::connection_hdl& hdl)
+    {
+        server.close(hdl, websocketpp::close::status::going_away, "");
+    }
+
+private:
+    Server server;
+    uint16_t port;
+    uint16_t maxPort;
+    bool running = false;
+    OpenHandler onOpen;
+    MessageHandler onMessage;
+};
+
+#ifndef usleep
+#define usleep(usec) std::this_thread::sleep_for(std::chrono::microseconds(usec))
+#endif
+
+using json = nlohmann::json;
+
+/// Number of failed checks so far
+inline int& failures()
+{
+    static int n = 0;
+    return n;
+}
+
+/// Print a failure and count it if ok is false
+inline void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what.c_str());
+        failures()++;
+    }
+}
+
+/// Poll ap until done() returns true or timeout. Returns false on timeout.
+template <class Client, class Done>
+bool poll_until(Client& ap, Done done, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+{
+    const auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < timeout) {
+        ap.poll();
+        if (done())
+            return true;
+        usleep(100);
+    }
+    return false;
+}
+
+/// TestServer on its own thread, started by the constructor and stopped when going out of scope
+class ScopedTestServer final {
+public:
+    explicit ScopedTestServer(TestServer::OpenHandler onOpen, TestServer::MessageHandler onMessage=nullptr)
+        : server(38281, 38291, std::move(onOpen), std::move(onMessage))
+    {
+        printf("Starting server...\n");
+        thread = server.start();
+    }
+
+    ~ScopedTestServer()
+    {
+        printf("Stopping server...\n");
+        server.stop();
+        thread.join();
+    }
+
+    std::string get_uri() const
+    {
+        return "ws://localhost:" + std::to_string(server.get_port());
+    }
+
+    TestServer server;
+
+private:
+    std::thread thread;
+};
+
+/// Print socket errors and set error
+inline void report_socket_errors(APClient& ap, bool& error)
+{
+    ap.set_socket_error_handler([&error](const std::string& msg) {
+        printf("socket error: %s\n", msg.c_str());
+        error = true;
+    });
+}
+
+/// Print socket errors and set error, connect to slot "Player" when RoomInfo is received
+inline void connect_on_room_info(APClient& ap, bool& error)
+{
+    report_socket_errors(ap, error);
+    ap.set_room_info_handler([&ap]() {
+        ap.ConnectSlot("Player", "", 0b111);
+    });
+}
+
+/// RoomInfo for a room with the given games. checksums maps games to data package checksums.
+inline json make_room_info(const json& games = json::array(), const json& checksums = json::object())
+{
+    json roomInfo = {
+        {"cmd", "RoomInfo"},
+        {"seed_name", "seed_name"},
+        {"time", 0},
+        {"games", games},
+        {"version", {{"major", 0}, {"minor", 6}, {"build", 3}, {"class", "Version"}}},
+    };
+    if (!checksums.empty())
+        roomInfo["datapackage_checksums"] = checksums;
+    return roomInfo;
+}
+
+/// Send RoomInfo, usable as OpenHandler
+inline void send_room_info(TestServer& server, const websocketpp::connection_hdl& hdl)
+{
+    server.send(hdl, json::array({make_room_info()}).dump());
+}
+
+/// Connected reply for slot 1 named "Player"
+inline json make_connected(const json& slotData = json::object())
+{
+    return {
+        {"cmd", "Connected"},
+        {"team", 0},
+        {"slot", 1},
+        {"players", {{{"team", 0}, {"slot", 1}, {"alias", "Player"}, {"name", "Player"}}}},
+        {"missing_locations", json::array()},
+        {"checked_locations", json::array()},
+        {"slot_data", slotData},
+        {"slot_info", json::object()},
+        {"hint_points", 0},
+    };
+}
+
+/// Connected reply where slot i + 1 plays games[i]. Slot 1 is "Player", the others are "Player<slot>".
+inline json make_connected_for(const json& games)
+{
+    json connected = make_connected();
+    connected["players"] = json::array();
+    for (size_t i = 0; i < games.size(); i++) {
+        const int slot = static_cast<int>(i) + 1;
+        const std::string name = slot == 1 ? "Player" : "Player" + std::to_string(slot);
+        connected["players"].push_back({{"team", 0}, {"slot", slot}, {"alias", name}, {"name", name}});
+        connected["slot_info"][std::to_string(slot)] = {
+            {"name", name}, {"game", games[i]}, {"type", 1}, {"group_members", json::array()},
+            {"class", "NetworkSlot"},
+        };
+    }
+    return connected;
+}
+
+/// Data package of a made-up game with count items and locations, with ids starting at base.
+/// Names are "<game> Item <i>" and "<game> Location <i>", the checksum is "<game> checksum".
+inline json make_game_data(const std::string& game, int64_t base, int count)
+{
+    json data = {
+        {"item_name_to_id", json::object()},
+        {"location_name_to_id", json::object()},
+        {"checksum", game + " checksum"},
+    };
+    for (int i = 0; i < count; i++) {
+        data["item_name_to_id"][game + " Item " + std::to_string(i)] = base + i;
+        data["location_name_to_id"][game + " Location " + std::to_string(i)] = base + i;
+    }
+    return data;
+}
+
+/// Checksums of all games in a data package, for make_room_info
+inline json get_checksums(const json& packageGames)
+{
+    json checksums = json::object();
+    for (const auto& pair: packageGames.items())
+        checksums[pair.key()] = pair.value()["checksum"];
+    return checksums;
+}
+
+/// DataPackage reply to a GetDataPackage for the requested games of packageGames
+inline json make_data_package(const json& packageGames, const json& command)
+{
+    json games = json::object();
+    for (const auto& game: command["games"]) {
+        const auto it = packageGames.find(game.get<std::string>());
+        if (it != packageGames.end())
+            games[game.get<std::string>()] = *it;
+    }
+    return {{"cmd", "DataPackage"}, {"data", {{"games", games}}}};
+}
+
+/// Data package store that keeps everything in memory, counts loads and returns given size hints
+class MemoryDataPackageStore final : public APDataPackageStore {
+public:
+    bool load(const std::string& game, const std::string& checksum, json& data) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loads++;
+        const auto it = games.find(game);
+        if (it == games.end() || it->second.value("checksum", "") != checksum)
+            return false;
+        data = it->second;
+        return true;
+    }
+
+    bool save(const std::string& game, const json& data) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        games[game] = data;
+        return true;
+    }
+
+    bool contains(const std::string& game, const std::string& checksum) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = games.find(game);
+        return it != games.end() && it->second.value("checksum", "") == checksum;
+    }
+
+    size_t get_size_hint(const std::string& game) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = sizeHints.find(game);
+        return it == sizeHints.end() ? 0 : it->second;
+    }
+
+    bool is_thread_safe() const override
+    {
+        return true;
+    }
+
+    /// Set the size returned by get_size_hint
+    void set_size_hint(const std::string& game, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sizeHints[game] = size;
+    }
+
+    /// Number of load calls so far
+    int get_loads()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return loads;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<std::string, json> games;
+    std::map<std::string, size_t> sizeHints;
+    int loads = 0;
+};
+
+/// Everything the server echoes back from a request
+inline json get_extras(const json& command)
+{
+    json extras = json::object();
+    for (const auto& pair: command.items()) {
+        if (pair.key() != "cmd" && pair.key() != "keys" && pair.key() != "key" && pair.key() != "default"
+                && pair.key() != "want_reply" && pair.key() != "operations")
+            extras[pair.key()] = pair.value();
+    }
+    return extras;
+}
+
+/// Retrieved reply to a Get for the values in storage
+inline json make_retrieved(const json& storage, const json& command)
+{
+    json keys = json::object();
+    for (const auto& key: command["keys"])
+        keys[key.get<std::string>()] = storage.value(key.get<std::string>(), json());
+    json retrieved = {{"cmd", "Retrieved"}, {"keys", keys}};
+    retrieved.update(get_extras(command));
+    return retrieved;
+}
+
+/// Apply a Set to storage and return the SetReply
+inline json apply_set(json& storage, const json& command)
+{
+    const auto key = command["key"].get<std::string>();
+    std::list<APClient::DataStorageOperation> operations;
+    for (const auto& op: command["operations"])
+        operations.push_back({op["operation"].get<std::string>(), op["value"]});
+    const json original = storage.value(key, json());
+    storage[key] = APClient::apply_data_storage_operations(original, command.value("default", json()), operations);
+    json setReply = {{"cmd", "SetReply"}, {"key", key}, {"value", storage[key]}, {"original_value", original}};
+    setReply.update(get_extras(command));
+    return setReply;
+}
+
+#endif // _TESTSERVER_HPP